@@ -0,0 +1,242 @@
+#!/usr/bin/env python3
+# Benchmark driver: runs the generator on dictionaries of increasing size
+# and writes one CSV row per run, to be diffed across commits.
+#
+# Dictionaries are synthetic (built from a fixed seed, so every run of the
+# driver sees the same words) unless given with --dict. Each run happens in
+# a fresh directory with the automata cache disabled, so build times are
+# cold, and its figures come from the --stats output of the generator.
+
+import argparse
+import csv
+import json
+import os
+import random
+import subprocess
+import sys
+import tempfile
+import time
+
+SIZES = [10000, 50000, 200000, 1000000]
+
+ONSETS = ["", "b", "c", "d", "f", "g", "l", "m", "n", "p", "r", "s", "t", "v",
+          "br", "ch", "cr", "dr", "gr", "pl", "pr", "st", "tr"]
+ONSET_WEIGHTS = [6, 3, 4, 4, 2, 2, 5, 4, 5, 4, 6, 6, 6, 2,
+                 1, 1, 1, 1, 1, 1, 1, 1, 1]
+VOWELS = ["a", "e", "i", "o", "u", "ai", "ou", "ie"]
+VOWEL_WEIGHTS = [10, 14, 8, 7, 5, 1, 1, 1]
+CODAS = ["", "", "", "", "n", "r", "s", "t", "l"]
+
+# Word length distribution, roughly that of a real word list
+LENGTH_WEIGHTS = {2: 1, 3: 3, 4: 6, 5: 9, 6: 11, 7: 12, 8: 12, 9: 10, 10: 8, 11: 6, 12: 4, 13: 3}
+
+# Fixed layout for the engine and propagation comparisons ('#': black)
+PATTERN = [
+    "....#......",
+    "....#......",
+    "....#......",
+    "......#....",
+    "###....#...",
+    "...#...#...",
+    "...#....###",
+    "....#......",
+    "......#....",
+    "......#....",
+    "......#....",
+]
+
+FIELDS = ["commit", "dictionary", "words", "scenario", "width", "height", "options", "seed", "status",
+          "wall_ms", "dict_load_ms", "dfa_build_ms", "dfa_convert_ms", "dfa_states", "dfa_transitions",
+          "peak_rss_kb", "first_grid_ms", "nodes", "fails", "restarts", "propagations"]
+
+
+def synthetic_words(count, seed):
+    """count distinct pronounceable words, the same ones for a given seed"""
+    rng = random.Random(seed)
+    lengths = list(LENGTH_WEIGHTS)
+    weights = [LENGTH_WEIGHTS[l] for l in lengths]
+    words = set()
+    while len(words) < count:
+        length = rng.choices(lengths, weights)[0]
+        word = ""
+        while len(word) < length:
+            word += rng.choices(ONSETS, ONSET_WEIGHTS)[0] + rng.choices(VOWELS, VOWEL_WEIGHTS)[0] + rng.choice(CODAS)
+        words.add(word[:length])
+    return sorted(words)
+
+
+def dictionary_file(size, seed, directory):
+    """Path of the synthetic dictionary of that size, generated once"""
+    path = os.path.join(directory, "synthetic-%d-%d.txt" % (size, seed))
+    if not os.path.exists(path):
+        os.makedirs(directory, exist_ok=True)
+        with open(path + ".tmp", "w") as f:
+            f.write("\n".join(synthetic_words(size, seed)) + "\n")
+        os.replace(path + ".tmp", path)
+    return path
+
+
+def mandatory_words(dictionary, count, maxlen, seed):
+    with open(dictionary) as f:
+        words = [w.strip() for w in f if 4 <= len(w.strip()) <= maxlen]
+    return random.Random(seed).sample(words, min(count, len(words)))
+
+
+def git_commit():
+    try:
+        return subprocess.check_output(["git", "rev-parse", "--short", "HEAD"],
+                                       stderr=subprocess.DEVNULL, text=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return ""
+
+
+def run(binary, dictionary, options, timeout, mandatory=None, pattern=None):
+    """Runs the generator once, returns (status, wall ms, stats or None)"""
+    with tempfile.TemporaryDirectory(prefix="crosswords-bench-") as work:
+        os.symlink(os.path.abspath(dictionary), os.path.join(work, "dict"))
+        if mandatory:
+            with open(os.path.join(work, "mandatory"), "w") as f:
+                f.write("\n".join(mandatory) + "\n")
+        if pattern:
+            with open(os.path.join(work, "pattern"), "w") as f:
+                f.write("\n".join(pattern) + "\n")
+            options = options + ["--pattern", "pattern"]
+
+        command = [os.path.abspath(binary), "--no-dfa-cache", "--stats", "stats.json"] + options
+        start = time.monotonic()
+        try:
+            result = subprocess.run(command, cwd=work, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                                    text=True, timeout=timeout)
+        except subprocess.TimeoutExpired:
+            return "killed", (time.monotonic() - start) * 1000, None
+        wall = (time.monotonic() - start) * 1000
+
+        try:
+            with open(os.path.join(work, "stats.json")) as f:
+                stats = json.load(f)
+        except (OSError, ValueError):
+            sys.stderr.write(result.stderr)
+            return "error", wall, None
+
+        if result.returncode != 0:
+            status = "error"
+        elif stats["search_totals"]["solutions"] > 0:
+            status = "ok"
+        else:
+            status = "timeout"
+        return status, wall, stats
+
+
+def row(commit, dictionary, words, scenario, width, height, options, seed, status, wall, stats):
+    r = {"commit": commit, "dictionary": os.path.basename(dictionary), "words": words, "scenario": scenario,
+         "width": width, "height": height, "options": " ".join(options), "seed": seed, "status": status,
+         "wall_ms": round(wall)}
+    if stats is None:
+        return r
+
+    def phases(prefix):
+        return sum(p["ms"] for p in stats["phases"] if p["name"].startswith(prefix))
+
+    solved = [s["ms"] for s in stats["searches"] if s["solutions"] > 0]
+    totals = stats["search_totals"]
+    r.update({
+        "dict_load_ms": round(phases("dictionary load"), 1),
+        # Graphs are built in parallel: this is CPU time, not latency
+        "dfa_build_ms": round(phases("graph build") + phases("graph load"), 1),
+        "dfa_convert_ms": round(phases("gecode conversion"), 1),
+        "dfa_states": stats["automata"]["states"],
+        "dfa_transitions": stats["automata"]["transitions"],
+        "peak_rss_kb": stats["peak_rss_kb"],
+        "first_grid_ms": round(min(solved), 1) if solved else "",
+        "nodes": totals["nodes"],
+        "fails": totals["fails"],
+        "restarts": totals["restarts"],
+        "propagations": totals["propagations"],
+    })
+    return r
+
+
+def scenarios(selected, reference, seed):
+    """(scenario, dictionary filter, width, height, options, mandatory count, pattern)"""
+    base = ["--seed", str(seed)]
+    every = lambda size: True
+    only_reference = lambda size: size == reference
+    if "core" in selected:
+        yield "free", every, 9, 11, base, 0, None
+        # Same words, placed by one search per placement or by a single one
+        yield "mandatory-permutations", every, 9, 11, base + ["--mandatory-mode", "permutations"], 3, None
+        yield "mandatory-single", every, 9, 11, base + ["--mandatory-mode", "single"], 3, None
+    if "restarts" in selected:
+        # Each policy without and with no-goods
+        for policy, scale in [("constant", 70000), ("luby", 1000), ("geometric", 1000), ("linear", 10000)]:
+            restart = base + ["--restart", policy, "--restart-scale", str(scale)]
+            yield "restart-" + policy, only_reference, 9, 11, restart, 0, None
+            yield "restart-" + policy + "-nogoods", only_reference, 9, 11, restart + ["--nogoods", "128"], 0, None
+    if "area" in selected:
+        for width, height in [(7, 7), (9, 11), (11, 13), (13, 13), (15, 15)]:
+            yield "area-slots", only_reference, width, height, base + ["--model", "slots"], 0, None
+    if "engines" in selected:
+        # The Gecode and native engines head to head on every dictionary
+        yield "pattern-automata", every, 11, 11, base, 0, PATTERN
+        yield "pattern-native", every, 11, 11, base + ["--engine", "native"], 0, PATTERN
+        yield "pattern-table", only_reference, 11, 11, base + ["--propagation", "table"], 0, PATTERN
+        yield "pattern-pruned", only_reference, 11, 11, base + ["--prune"], 0, PATTERN
+    if "encodings" in selected:
+        # Same grid and seed, to compare the nodes and propagations of each
+        yield "encoding-symbol", only_reference, 9, 11, base, 0, None
+        yield "encoding-channel", only_reference, 9, 11, base + ["--encoding", "channel"], 0, None
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmarks the generator, one CSV row per run")
+    parser.add_argument("--binary", default="./crosswords")
+    parser.add_argument("--dict", action="append", default=[],
+                        help="dictionary to use instead of the synthetic ones (repeatable)")
+    parser.add_argument("--sizes", default=",".join(str(s) for s in SIZES),
+                        help="synthetic dictionary sizes (default %(default)s)")
+    parser.add_argument("--reference", type=int, default=50000,
+                        help="synthetic size (or --dict rank, from 0) of the restart, area and engine runs")
+    parser.add_argument("--scenarios", default="core,restarts,area,engines,encodings")
+    parser.add_argument("--seed", type=int, default=1, help="dictionary and search seed")
+    parser.add_argument("--time-limit", type=int, default=60000, help="search budget per run, in ms")
+    parser.add_argument("--timeout", type=int, default=900, help="kill a run after that many seconds")
+    parser.add_argument("--data", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "data"),
+                        help="where synthetic dictionaries are kept")
+    parser.add_argument("--output", default="-", help="CSV file (default: standard output)")
+    args = parser.parse_args()
+
+    if not os.path.exists(args.binary):
+        sys.exit("%s not found, build it first" % args.binary)
+
+    if args.dict:
+        dictionaries = [(path, rank) for rank, path in enumerate(args.dict)]
+    else:
+        sizes = [int(s) for s in args.sizes.split(",") if s]
+        dictionaries = [(dictionary_file(size, args.seed, args.data), size) for size in sizes]
+
+    out = sys.stdout if args.output == "-" else open(args.output, "w", newline="")
+    writer = csv.DictWriter(out, FIELDS)
+    writer.writeheader()
+    out.flush()
+
+    commit = git_commit()
+    selected = set(args.scenarios.split(","))
+    for dictionary, key in dictionaries:
+        with open(dictionary) as f:
+            words = sum(1 for _ in f)
+        for scenario, wanted, width, height, options, mandatory, pattern in scenarios(selected, args.reference, args.seed):
+            if not wanted(key):
+                continue
+            options = options + ["--time-limit", str(args.time_limit)]
+            if not pattern:
+                options = options + ["--width", str(width), "--height", str(height)]
+            required = mandatory_words(dictionary, mandatory, min(width, height), args.seed) if mandatory else None
+
+            sys.stderr.write("%s %s %dx%d...\n" % (os.path.basename(dictionary), scenario, width, height))
+            status, wall, stats = run(args.binary, dictionary, options, args.timeout, required, pattern)
+            writer.writerow(row(commit, dictionary, words, scenario, width, height, options, args.seed, status, wall, stats))
+            out.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+# Benchmark summary: reads the CSV of bench.py and prints, for each of its
+# comparisons, one table of the runs it made, to quote in commit messages
+# next to the committed results.
+#
+# Only the rows of the most recent commit in the file are summarized,
+# unless --commit picks another one.
+
+import argparse
+import csv
+import sys
+
+# (title, scenario prefix, columns): the runs of each comparison
+TABLES = [
+    ("Mandatory words: one search per placement vs a single search", "mandatory-",
+     ["dictionary", "scenario", "status", "first_grid_ms", "wall_ms", "nodes", "fails"]),
+    ("Restart policies, same seed", "restart-",
+     ["scenario", "status", "first_grid_ms", "nodes", "fails", "restarts"]),
+    ("Slot model: time to the first grid by area", "area-",
+     ["width", "height", "area", "status", "first_grid_ms", "dfa_build_ms", "nodes", "peak_rss_kb"]),
+    ("Fixed pattern: Gecode engines vs the native one", "pattern-",
+     ["dictionary", "scenario", "status", "wall_ms", "first_grid_ms", "dfa_build_ms", "nodes", "peak_rss_kb"]),
+]
+
+
+def table(rows, columns):
+    """Plain text table, columns padded to their widest cell"""
+    cells = [columns] + [[str(r.get(c, "")) for c in columns] for r in rows]
+    widths = [max(len(line[i]) for line in cells) for i in range(len(columns))]
+    return "\n".join("  ".join(cell.ljust(width) for cell, width in zip(line, widths)).rstrip() for line in cells)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Summarizes bench.py results, one table per comparison")
+    parser.add_argument("results", nargs="?", default="bench/results.csv")
+    parser.add_argument("--commit", help="commit whose runs to summarize (default: the last one in the file)")
+    args = parser.parse_args()
+
+    try:
+        with open(args.results, newline="") as f:
+            rows = list(csv.DictReader(f))
+    except OSError as e:
+        sys.exit("%s: %s" % (args.results, e.strerror))
+    if not rows:
+        sys.exit("%s holds no runs" % args.results)
+
+    commit = args.commit if args.commit is not None else rows[-1]["commit"]
+    rows = [r for r in rows if r["commit"] == commit]
+    for r in rows:
+        if r["width"].isdigit() and r["height"].isdigit():
+            r["area"] = int(r["width"]) * int(r["height"])
+    print("commit %s" % (commit or "unknown"))
+    for title, prefix, columns in TABLES:
+        runs = [r for r in rows if r["scenario"].startswith(prefix)]
+        if runs:
+            print("\n%s\n%s" % (title, table(runs, columns)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,237 @@
+#ifndef DAEMON_HPP
+#define DAEMON_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "json.hpp"
+
+// Serves newline-delimited JSON requests, read from a stream (stdin) or
+// from the connections of a Unix socket, on a fixed pool of workers. Each
+// request is answered with one JSON line on the stream it came from, in
+// the order the requests complete.
+//
+// The handler turns a parsed request into the reply line (without the
+// newline); requests that are not valid JSON objects are answered with
+// {"status":"error","error":"..."} without reaching it.
+class Daemon
+{
+    public:
+        typedef std::function<std::string(const JsonValue &request)> Handler;
+
+        Daemon(size_t workers, Handler handler):
+            handler(std::move(handler)),
+            closed(false)
+        {
+            for(size_t i = 0; i < workers; ++i)
+                threads.emplace_back(&Daemon::work, this);
+        }
+
+        Daemon(const Daemon &) = delete;
+        Daemon &operator=(const Daemon &) = delete;
+
+        // Finishes the queued requests before returning
+        ~Daemon()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closed = true;
+            }
+            ready.notify_all();
+            for(auto &thread : threads)
+                thread.join();
+        }
+
+        // Reads requests from in until end of file, replies go to out
+        void ServeStream(int in, int out)
+        {
+            serve(std::make_shared<Channel>(in, out, false));
+        }
+
+        // Accepts connections forever, returns false (errno telling why) if
+        // the socket cannot be set up. A stale socket at path is replaced,
+        // any other file is left alone.
+        bool ServeSocket(const std::string &path)
+        {
+            sockaddr_un address;
+            std::memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            if(path.size() >= sizeof(address.sun_path))
+            {
+                errno = ENAMETOOLONG;
+                return false;
+            }
+            std::strcpy(address.sun_path, path.c_str());
+
+            struct stat st;
+            if(lstat(path.c_str(), &st) == 0)
+            {
+                if(!S_ISSOCK(st.st_mode))
+                {
+                    errno = EEXIST;
+                    return false;
+                }
+                unlink(path.c_str());
+            }
+
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if(fd < 0)
+                return false;
+
+            if(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(fd, 16) < 0)
+            {
+                close(fd);
+                return false;
+            }
+
+            while(true)
+            {
+                int connection = accept(fd, nullptr, nullptr);
+                if(connection < 0)
+                {
+                    if(errno == EINTR)
+                        continue;
+                    close(fd);
+                    return false;
+                }
+
+                // One reader per connection, the workers are shared
+                std::thread(&Daemon::serve, this, std::make_shared<Channel>(connection, connection, true)).detach();
+            }
+        }
+
+    private:
+        // Where the replies of the requests read from one stream go. The
+        // connection is closed once the reader and every pending request
+        // are done with it.
+        struct Channel
+        {
+            Channel(int in, int out, bool owned):
+                in(in),
+                out(out),
+                owned(owned)
+            {
+            }
+
+            ~Channel()
+            {
+                if(owned)
+                    close(in);
+            }
+
+            void Reply(std::string line)
+            {
+                line += '\n';
+                std::lock_guard<std::mutex> lock(mutex);
+                size_t written = 0;
+                while(written < line.size())
+                {
+                    // Sockets must not raise SIGPIPE when the client left
+                    ssize_t n = owned ? send(out, line.data() + written, line.size() - written, MSG_NOSIGNAL)
+                                      : write(out, line.data() + written, line.size() - written);
+                    if(n < 0 && errno == EINTR)
+                        continue;
+                    if(n <= 0)
+                        return; // peer gone
+                    written += n;
+                }
+            }
+
+            int in;
+            int out;
+            bool owned;
+            std::mutex mutex;
+        };
+
+        struct Job
+        {
+            std::string line;
+            std::shared_ptr<Channel> channel;
+        };
+
+        static std::string errorReply(const std::string &error)
+        {
+            return "{\"status\":\"error\",\"error\":" + JsonValue::Quote(error) + "}";
+        }
+
+        void serve(std::shared_ptr<Channel> channel)
+        {
+            std::string pending;
+            char buffer[4096];
+            while(true)
+            {
+                ssize_t n = read(channel->in, buffer, sizeof(buffer));
+                if(n < 0 && errno == EINTR)
+                    continue;
+                if(n <= 0)
+                    break;
+
+                pending.append(buffer, n);
+                size_t start = 0;
+                for(size_t end; (end = pending.find('\n', start)) != std::string::npos; start = end + 1)
+                    push(pending.substr(start, end - start), channel);
+                pending.erase(0, start);
+            }
+            push(pending, channel);
+        }
+
+        void push(const std::string &line, const std::shared_ptr<Channel> &channel)
+        {
+            if(line.find_first_not_of(" \t\r") == std::string::npos)
+                return;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back(Job{line, channel});
+            }
+            ready.notify_one();
+        }
+
+        void work()
+        {
+            while(true)
+            {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    ready.wait(lock, [this] { return closed || !jobs.empty(); });
+                    if(jobs.empty())
+                        return;
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                }
+
+                JsonValue request;
+                std::string error;
+                if(!JsonValue::Parse(job.line, request, error))
+                    job.channel->Reply(errorReply("invalid request: " + error));
+                else if(!request.IsObject())
+                    job.channel->Reply(errorReply("invalid request: expected an object"));
+                else
+                    job.channel->Reply(handler(request));
+            }
+        }
+
+        Handler handler;
+
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<Job> jobs;
+        bool closed;
+
+        std::vector<std::thread> threads;
+};
+
+#endif
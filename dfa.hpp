@@ -2,66 +2,128 @@
 #define DFA_HPP
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
 #include <vector>
+#include <string_view>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+
+#include <unistd.h>
 
 #include <gecode/int.hh>
 
 #include "dictionary.hpp"
+#include "stats.hpp"
 
 const int DFA_MIN_SYMBOL = 'a';
 const int DFA_MAX_SYMBOL = 'z'+1;
 
-struct DictionaryTransition
+// How a slot's word index relates to its automaton:
+//  - INDEX_SYMBOL: the index is read by the automaton right after the
+//    letters, so every word gets its own tail and a huge alphabet.
+//  - INDEX_CHANNEL: the automaton only accepts positions, letters and
+//    lengths; indices are linked to letters by the WordChannel propagator
+//    (see wordchannel.hpp), which lets word suffixes be shared.
+enum IndexEncoding
 {
-    DictionaryTransition(int n, int s):
-        nodeFrom(n),
-        symbol(s)
-    {
-    }
-
-    int nodeFrom;
-    int symbol;
+    INDEX_SYMBOL,
+    INDEX_CHANNEL
 };
 
+// Transitions are kept in the exact layout Gecode::DFA consumes, so that
+// conversion reads them in place. Lookups during construction go through an
+// open-addressing index over (state, symbol) keys instead of a tree.
 struct Graph
 {
 public:
     Graph():
         latestState(0)
     {
+        transitions.push_back(Gecode::DFA::Transition(-1, 0, 0));
+        finalStates.push_back(-1);
     }
 
     Gecode::DFA *ToGecodeAlloc() const
     {
-        Gecode::DFA::Transition *t = new Gecode::DFA::Transition[transitions.size() + 1];
-        int *f = new int[finalStates.size() + 1];
+        // Both arrays are terminated by a sentinel (-1), Gecode only reads
+        // them to fill its own tables
+        return new Gecode::DFA(0,
+                               const_cast<Gecode::DFA::Transition*>(transitions.data()),
+                               const_cast<int*>(finalStates.data()),
+                               false);
+    }
 
-        size_t i = 0;
-        for(const auto it: transitions)
+    size_t StateCount() const
+    {
+        return latestState + 1;
+    }
+
+    size_t TransitionCount() const
+    {
+        return transitions.size() - 1;
+    }
+
+    // Serializes the finished graph: state count, then both
+    // sentinel-terminated arrays
+    void Write(std::ostream &os) const
+    {
+        uint64_t sizes[3] = {(uint64_t) latestState, transitions.size(), finalStates.size()};
+        os.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+        for(const auto &t : transitions)
         {
-            t[i] = Gecode::DFA::Transition(it.first.nodeFrom, it.first.symbol, it.second);
-            ++i;
+            int32_t raw[3] = {t.i_state, t.symbol, t.o_state};
+            os.write(reinterpret_cast<const char*>(raw), sizeof(raw));
         }
-        t[i] = {-1, 0, 0};
+        os.write(reinterpret_cast<const char*>(finalStates.data()), finalStates.size() * sizeof(int));
+    }
 
-        i = 0;
-        for(int state : finalStates)
+    // Reads what Write produced, returns false on truncated or
+    // inconsistent input (the graph is then left empty)
+    bool Read(const char *data, size_t size)
+    {
+        uint64_t sizes[3];
+        if(size < sizeof(sizes))
+            return false;
+        std::memcpy(sizes, data, sizeof(sizes));
+        if(sizes[1] < 1 || sizes[2] < 1
+        || size != sizeof(sizes) + sizes[1] * 3 * sizeof(int32_t) + sizes[2] * sizeof(int))
+            return false;
+        data += sizeof(sizes);
+
+        latestState = sizes[0];
+        transitions.resize(sizes[1]);
+        for(auto &t : transitions)
         {
-            f[i] = state;
-            ++i;
+            int32_t raw[3];
+            std::memcpy(raw, data, sizeof(raw));
+            data += sizeof(raw);
+            t = Gecode::DFA::Transition(raw[0], raw[1], raw[2]);
         }
-        f[i] = -1;
+        finalStates.resize(sizes[2]);
+        std::memcpy(finalStates.data(), data, finalStates.size() * sizeof(int));
+        std::vector<uint32_t>().swap(index);
 
-        Gecode::DFA *ret = new Gecode::DFA(0, t, f, false);
+        if(transitions.back().i_state == -1 && finalStates.back() == -1)
+            return true;
 
-        delete [] t;
-        delete [] f;
-
-        return ret;
+        *this = Graph();
+        return false;
     }
 
-    void MakeBorder(const Dictionary &dict, size_t length)
+    void MakeBorder(const Dictionary &dict, size_t length, IndexEncoding encoding = INDEX_SYMBOL)
     {
         const auto &words = dict.GetCollection(length);
         int baseindex = dict.FirstIndexOfLength(length);
@@ -71,12 +133,14 @@ public:
             // Initial state is always 0
             int state = addWord(word, 0);
             int wordIndex = baseindex + (i++);
-            int finalState = tryTransitionOrCreate(state, wordIndex);
+            int finalState = encoding == INDEX_SYMBOL ? tryTransitionOrCreate(state, wordIndex) : state;
             makeStateFinal(finalState);
         }
+
+        finish();
     }
 
-    void MakeFirst(const Dictionary &dict, size_t maxlength)
+    void MakeFirst(const Dictionary &dict, size_t maxlength, IndexEncoding encoding = INDEX_SYMBOL)
     {
         // Pos phase (first => pos == 0 || pos == 2)
         int pos0state = tryTransitionOrCreate(0, 0);
@@ -85,9 +149,9 @@ public:
         // Transitions from pos2state to pos1state for all symbols except black tile
         int pos1state = tryTransitionOrCreate(pos2state, DFA_MIN_SYMBOL);
         for(int c = DFA_MIN_SYMBOL+1; c < DFA_MAX_SYMBOL; ++c)
-            transitions.insert(std::make_pair(DictionaryTransition{pos2state, c}, pos1state));
+            addTransition(pos2state, c, pos1state);
         // Transition: pos1state -- black tile --> pos0state
-        transitions.insert(std::make_pair(DictionaryTransition{pos1state, DFA_MAX_SYMBOL}, pos0state));
+        addTransition(pos1state, DFA_MAX_SYMBOL, pos0state);
 
         // Letter phase
         for(size_t length = 2; length <= maxlength; ++length)
@@ -103,21 +167,27 @@ public:
                 int state = addWord(word, pos0state); // Start word at pos 0
                 int wordIndex = baseindex + (i++);
 
-                int indexState = tryTransitionOrCreate(state, wordIndex);
-                makeStateFinal(tryTransitionOrCreate(indexState, length));
+                int indexState = encoding == INDEX_SYMBOL ? tryTransitionOrCreate(state, wordIndex) : state;
+                int finalState = tryTransitionOrCreate(indexState, length);
+                makeStateFinal(finalState);
 
                 if(length < maxlength)
                 {
                     state = tryTransitionOrCreate(state, DFA_MAX_SYMBOL);
                     for(int c = DFA_MIN_SYMBOL; c <= DFA_MAX_SYMBOL; ++c)
-                        transitions.insert(std::make_pair(DictionaryTransition{state, c}, state));
-                    transitions.insert(std::make_pair(DictionaryTransition{state, wordIndex}, indexState));
+                        addTransition(state, c, state);
+                    if(encoding == INDEX_SYMBOL)
+                        addTransition(state, wordIndex, indexState);
+                    else
+                        addTransition(state, length, finalState);
                 }
             }
         }
+
+        finish();
     }
 
-    void MakeSecond(const Dictionary &dict, size_t maxlength)
+    void MakeSecond(const Dictionary &dict, size_t maxlength, IndexEncoding encoding = INDEX_SYMBOL)
     {
         // Pos phase (pos in [3, maxlength-2])
         for(int pos = 3; pos <= (int)maxlength-2; ++pos)
@@ -126,19 +196,22 @@ public:
             if(pos > 4)
             {
                 for(int c = DFA_MIN_SYMBOL; c <= DFA_MAX_SYMBOL; ++c)
-                    transitions.insert(std::make_pair(DictionaryTransition{pos-2, c}, pos-3));
+                    addTransition(pos-2, c, pos-3);
             }
         }
 
-        transitions.insert(std::make_pair(DictionaryTransition{2, DFA_MAX_SYMBOL}, 1));
+        addTransition(2, DFA_MAX_SYMBOL, 1);
 
         // Add bypass when there is no second word
         int state = tryTransitionOrCreate(0, maxlength);
-        transitions.insert(std::make_pair(DictionaryTransition{0, (int)maxlength-1}, state));
-        transitions.insert(std::make_pair(DictionaryTransition{0, (int)maxlength+1}, state));
+        addTransition(0, (int)maxlength-1, state);
+        addTransition(0, (int)maxlength+1, state);
         for(int c = DFA_MIN_SYMBOL; c <= DFA_MAX_SYMBOL; ++c)
-            transitions.insert(std::make_pair(DictionaryTransition{state, c}, state));
-        makeStateFinal(tryTransitionOrCreate(state, MIN_INDEX)); // MIN_INDEX = no word
+            addTransition(state, c, state);
+        if(encoding == INDEX_SYMBOL)
+            makeStateFinal(tryTransitionOrCreate(state, MIN_INDEX)); // MIN_INDEX = no word
+        else
+            makeStateFinal(state);
 
         int startState = 1;
         
@@ -153,19 +226,92 @@ public:
                 int state = addWord(word, startState); // Start word after startState
                 int wordIndex = baseindex + (i++);
 
-                int finalState = tryTransitionOrCreate(state, wordIndex);
+                int finalState = encoding == INDEX_SYMBOL ? tryTransitionOrCreate(state, wordIndex) : state;
                 makeStateFinal(finalState);
 
                 state = tryTransitionOrCreate(state, DFA_MAX_SYMBOL);
                 int lastLetter = createState();
                 for(int c = DFA_MIN_SYMBOL; c < DFA_MAX_SYMBOL; ++c)
-                    transitions.insert(std::make_pair(DictionaryTransition{state, c}, lastLetter));
-                transitions.insert(std::make_pair(DictionaryTransition{lastLetter, wordIndex}, finalState));
+                    addTransition(state, c, lastLetter);
+                if(encoding == INDEX_SYMBOL)
+                    addTransition(lastLetter, wordIndex, finalState);
+                else
+                    makeStateFinal(lastLetter);
+            }
+        }
+
+        finish();
+    }
+
+    // Rows or columns holding any number of words: every maximal run of at
+    // least 2 letters is a word of the dictionary, single letters (crossed
+    // by a word the other way) are allowed. Reads letters and black tiles
+    // only, whatever the index encoding.
+    //
+    // A black tile starts the line over, which makes the graph cyclic. It is
+    // built and minimized with black tiles leading to a separate final
+    // state instead, which is then merged into the initial state: states
+    // equivalent before the merge remain so after it.
+    void MakeLine(const Dictionary &dict, size_t length)
+    {
+        const int afterBlack = createState();
+        makeStateFinal(0);
+        makeStateFinal(afterBlack);
+        addTransition(0, DFA_MAX_SYMBOL, afterBlack);
+
+        for(int c = DFA_MIN_SYMBOL; c < DFA_MAX_SYMBOL; ++c)
+        {
+            int single = tryTransitionOrCreate(0, c);
+            makeStateFinal(single);
+            addTransition(single, DFA_MAX_SYMBOL, afterBlack);
+        }
+
+        for(size_t wordLength = 2; wordLength <= length; ++wordLength)
+        {
+            for(const auto &word : dict.GetCollection(wordLength))
+            {
+                int state = addWord(word, 0);
+                makeStateFinal(state);
+                addTransition(state, DFA_MAX_SYMBOL, afterBlack);
             }
         }
+
+        finish();
+
+        // The only state left without outgoing transitions
+        std::vector<char> hasOutgoing(latestState + 1, 0);
+        for(size_t i = 0; i + 1 < transitions.size(); ++i)
+            hasOutgoing[transitions[i].i_state] = 1;
+        int sink = std::find(hasOutgoing.begin(), hasOutgoing.end(), 0) - hasOutgoing.begin();
+        mergeInto(sink, 0);
     }
 
 private:
+    // Redirects the transitions into state from (which has no outgoing
+    // transitions) to state to, and removes it. The last state takes its
+    // number.
+    void mergeInto(int from, int to)
+    {
+        const int last = latestState;
+        auto rename = [&](int state) {
+            if(state == from)
+                return to;
+            return state == last ? from : state;
+        };
+
+        for(size_t i = 0; i + 1 < transitions.size(); ++i)
+        {
+            auto &t = transitions[i];
+            t = Gecode::DFA::Transition(rename(t.i_state), t.symbol, rename(t.o_state));
+        }
+
+        finalStates.erase(std::remove(finalStates.begin(), finalStates.end() - 1, from), finalStates.end() - 1);
+        for(size_t i = 0; i + 1 < finalStates.size(); ++i)
+            finalStates[i] = rename(finalStates[i]);
+
+        --latestState;
+    }
+
     int createState()
     {
         // Don't change this!
@@ -176,25 +322,32 @@ private:
     // Must be called after having called createDontCareLoop
     void makeStateFinal(int state)
     {
-        finalStates.push_back(state);
+        // Keep the sentinel last
+        finalStates.back() = state;
+        finalStates.push_back(-1);
     }
 
     int tryTransitionOrCreate(int stateFrom, int symbol)
     {
-        DictionaryTransition transition{stateFrom, symbol};
-        const auto it = transitions.find(transition);
-        if(it != transitions.cend()) // Transition exists
-        {
-            return it->second;
-        }
+        size_t slot = findSlot(stateFrom, symbol);
+        if(index[slot]) // Transition exists
+            return transitions[index[slot]-1].o_state;
 
         // else
         int newState = createState();
-        transitions.insert(std::make_pair(transition, newState));
+        insertAt(slot, stateFrom, symbol, newState);
         return newState;
     }
 
-    int addWord(const std::string &word, int initialState)
+    // Adds the transition unless one already leaves stateFrom with symbol
+    void addTransition(int stateFrom, int symbol, int stateTo)
+    {
+        size_t slot = findSlot(stateFrom, symbol);
+        if(!index[slot])
+            insertAt(slot, stateFrom, symbol, stateTo);
+    }
+
+    int addWord(std::string_view word, int initialState)
     {
         int currentState = initialState;
 
@@ -206,82 +359,569 @@ private:
         return currentState;
     }
 
+    // Called once the graph is complete: merges equivalent states, then
+    // drops the lookup index so that it does not coexist with the Gecode
+    // DFA. The index is rebuilt if the graph is extended again.
+    void finish()
+    {
+        minimize();
+
+        std::vector<uint32_t>().swap(index);
+        transitions.shrink_to_fit();
+        finalStates.shrink_to_fit();
+    }
+
+    // Merges states with identical right languages, bottom-up from the
+    // final states (Revuz's algorithm). Words of a length bucket share their
+    // prefixes through the trie, this additionally shares their suffixes.
+    // The graphs built here are acyclic apart from self-loops, which are
+    // handled by comparing them as loops rather than by target. Graphs with
+    // any other cycle are left untouched.
+    void minimize()
+    {
+        const int stateCount = latestState + 1;
+
+        // Group transitions by origin state (CSR layout), sorted by symbol
+        std::vector<uint32_t> first(stateCount + 1, 0);
+        for(size_t i = 0; i + 1 < transitions.size(); ++i)
+            ++first[transitions[i].i_state + 1];
+        for(int state = 0; state < stateCount; ++state)
+            first[state + 1] += first[state];
+
+        std::vector<Gecode::DFA::Transition> sorted(transitions.size() - 1);
+        {
+            std::vector<uint32_t> next(first.begin(), first.end()-1);
+            for(size_t i = 0; i + 1 < transitions.size(); ++i)
+                sorted[next[transitions[i].i_state]++] = transitions[i];
+        }
+        for(int state = 0; state < stateCount; ++state)
+            std::sort(sorted.begin() + first[state], sorted.begin() + first[state + 1], [](const Gecode::DFA::Transition &a, const Gecode::DFA::Transition &b) {
+                return a.symbol < b.symbol;
+            });
+
+        std::vector<char> isFinal(stateCount, 0);
+        for(size_t i = 0; i + 1 < finalStates.size(); ++i)
+            isFinal[finalStates[i]] = 1;
+
+        // Post-order DFS from the initial state, so that successors are
+        // registered before their predecessors
+        enum { UNVISITED, ACTIVE, DONE };
+        std::vector<char> visit(stateCount, UNVISITED);
+        std::vector<int> order;
+        order.reserve(stateCount);
+        std::vector<std::pair<int, uint32_t> > stack;
+        stack.emplace_back(0, first[0]);
+        visit[0] = ACTIVE;
+        while(!stack.empty())
+        {
+            auto &top = stack.back();
+            if(top.second == first[top.first + 1])
+            {
+                visit[top.first] = DONE;
+                order.push_back(top.first);
+                stack.pop_back();
+                continue;
+            }
+
+            int next = sorted[top.second++].o_state;
+            if(next == top.first || visit[next] == DONE)
+                continue;
+            if(visit[next] == ACTIVE)
+                return; // Not acyclic
+            visit[next] = ACTIVE;
+            stack.emplace_back(next, first[next]);
+        }
+
+        // Two states are equivalent when they agree on finality and on every
+        // (symbol, canonical target) pair, self-loops comparing as loops.
+        // Registered states are kept in an open-addressing table and their
+        // signatures are compared in place rather than stored.
+        std::vector<int> canonical(stateCount, -1);
+        auto target = [&](int state, uint32_t i) {
+            return sorted[i].o_state == state ? -1 : canonical[sorted[i].o_state];
+        };
+        auto signatureHash = [&](int state) {
+            size_t h = isFinal[state];
+            for(uint32_t i = first[state]; i < first[state + 1]; ++i)
+                h = (h ^ hashKey(sorted[i].symbol, target(state, i))) * 0x100000001b3ULL;
+            return h;
+        };
+        auto equivalent = [&](int a, int b) {
+            if(isFinal[a] != isFinal[b] || first[a+1] - first[a] != first[b+1] - first[b])
+                return false;
+            for(uint32_t i = first[a], j = first[b]; i < first[a + 1]; ++i, ++j)
+            {
+                if(sorted[i].symbol != sorted[j].symbol || target(a, i) != target(b, j))
+                    return false;
+            }
+            return true;
+        };
+
+        size_t capacity = 1024;
+        while(capacity <= 2 * order.size())
+            capacity *= 2;
+        std::vector<int> registry(capacity, -1);
+        for(int state : order)
+        {
+            size_t slot = signatureHash(state) & (capacity - 1);
+            while(registry[slot] >= 0 && !equivalent(registry[slot], state))
+                slot = (slot + 1) & (capacity - 1);
+            if(registry[slot] < 0)
+                registry[slot] = state;
+            canonical[state] = registry[slot];
+        }
+        std::vector<int>().swap(registry);
+
+        // Renumber the surviving states densely, keeping 0 as initial state
+        std::vector<int> renumber(stateCount, -1);
+        int newCount = 0;
+        renumber[canonical[0]] = newCount++;
+        for(auto it = order.rbegin(); it != order.rend(); ++it)
+        {
+            int state = canonical[*it];
+            if(renumber[state] < 0)
+                renumber[state] = newCount++;
+        }
+
+        transitions.clear();
+        finalStates.clear();
+        for(int state : order)
+        {
+            if(canonical[state] != state)
+                continue;
+            for(uint32_t i = first[state]; i < first[state + 1]; ++i)
+            {
+                const auto &t = sorted[i];
+                transitions.push_back(Gecode::DFA::Transition(renumber[state], t.symbol, renumber[canonical[t.o_state]]));
+            }
+            if(isFinal[state])
+                finalStates.push_back(renumber[state]);
+        }
+        transitions.push_back(Gecode::DFA::Transition(-1, 0, 0));
+        finalStates.push_back(-1);
+
+        latestState = newCount - 1;
+    }
+
+    static size_t hashKey(int stateFrom, int symbol)
+    {
+        uint64_t key = ((uint64_t)(uint32_t) stateFrom << 32) | (uint32_t) symbol;
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return key;
+    }
+
+    // Returns the slot holding (stateFrom, symbol), or the empty slot where
+    // it belongs. Slots store transition positions plus one, 0 is empty.
+    size_t findSlot(int stateFrom, int symbol)
+    {
+        if(2 * transitions.size() >= index.size())
+            rehash();
+
+        size_t mask = index.size() - 1;
+        size_t slot = hashKey(stateFrom, symbol) & mask;
+        while(index[slot])
+        {
+            const auto &t = transitions[index[slot]-1];
+            if(t.i_state == stateFrom && t.symbol == symbol)
+                break;
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    void insertAt(size_t slot, int stateFrom, int symbol, int stateTo)
+    {
+        // Keep the sentinel last
+        transitions.back() = Gecode::DFA::Transition(stateFrom, symbol, stateTo);
+        index[slot] = transitions.size();
+        transitions.push_back(Gecode::DFA::Transition(-1, 0, 0));
+    }
+
+    void rehash()
+    {
+        size_t capacity = 1024;
+        while(capacity <= 4 * transitions.size())
+            capacity *= 2;
+
+        index.assign(capacity, 0);
+        size_t mask = capacity - 1;
+        for(size_t i = 0; i + 1 < transitions.size(); ++i)
+        {
+            size_t slot = hashKey(transitions[i].i_state, transitions[i].symbol) & mask;
+            while(index[slot])
+                slot = (slot + 1) & mask;
+            index[slot] = i + 1;
+        }
+    }
+
     std::vector<int> finalStates;
-    std::map<DictionaryTransition, int> transitions;
+    std::vector<Gecode::DFA::Transition> transitions;
+    std::vector<uint32_t> index;
     int latestState;
 };
 
-bool operator<(const DictionaryTransition &a, const DictionaryTransition &b)
+enum GraphKind
+{
+    GRAPH_BORDER,
+    GRAPH_FIRST,
+    GRAPH_SECOND,
+    GRAPH_LINE
+};
+
+const char *const GRAPH_KIND_NAMES[] = {"border", "first", "second", "line"};
+
+// On-disk cache of finished graphs. A graph only depends on the dictionary
+// contents, its kind, its line length and the index encoding, which all
+// make up its file name. Files carry the full key in their header and a
+// checksum, and anything that does not validate is ignored and rebuilt.
+class DFACache
 {
-    return a.nodeFrom < b.nodeFrom
-        || (a.nodeFrom == b.nodeFrom && a.symbol < b.symbol);
-}
+    public:
+        // Bump whenever the graphs built by Graph::Make* change
+        static const uint32_t VERSION = 1;
+
+        // An empty directory disables the cache
+        DFACache(const std::string &directory, uint64_t dictionaryHash):
+            directory(directory),
+            dictionaryHash(dictionaryHash)
+        {
+        }
+
+        bool Load(GraphKind kind, size_t length, IndexEncoding encoding, Graph &graph) const
+        {
+            if(directory.empty())
+                return false;
+
+            std::ifstream file(path(kind, length, encoding), std::ios::binary);
+            std::stringstream contents;
+            contents << file.rdbuf();
+            std::string data = contents.str();
+
+            Header header;
+            if(data.size() < sizeof(header))
+                return false;
+            std::memcpy(&header, data.data(), sizeof(header));
+            Header expected = makeHeader(kind, length, encoding, data.data() + sizeof(header), data.size() - sizeof(header));
+            if(std::memcmp(&header, &expected, sizeof(header)) != 0)
+                return false;
+
+            return graph.Read(data.data() + sizeof(header), data.size() - sizeof(header));
+        }
+
+        void Store(GraphKind kind, size_t length, IndexEncoding encoding, const Graph &graph) const
+        {
+            if(directory.empty())
+                return;
+
+            std::ostringstream os;
+            graph.Write(os);
+            std::string data = os.str();
+            Header header = makeHeader(kind, length, encoding, data.data(), data.size());
+
+            // Write then rename, so that concurrent readers never see a
+            // partial file
+            std::error_code ec;
+            std::filesystem::create_directories(directory, ec);
+            std::string filename = path(kind, length, encoding);
+            // Unique across processes and across the threads of this one,
+            // which may store the same graph at once
+            static std::atomic<unsigned long> stored(0);
+            std::string temporary = filename + ".tmp" + std::to_string(getpid()) + "." + std::to_string(stored++);
+            {
+                std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+                file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                file.write(data.data(), data.size());
+                if(!file)
+                {
+                    std::remove(temporary.c_str());
+                    return;
+                }
+            }
+            std::filesystem::rename(temporary, filename, ec);
+            if(ec)
+                std::remove(temporary.c_str());
+        }
+
+    private:
+        struct Header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t kind;
+            uint64_t length;
+            uint64_t encoding;
+            uint64_t dictionaryHash;
+            uint64_t checksum;
+        };
+
+        Header makeHeader(GraphKind kind, size_t length, IndexEncoding encoding, const char *data, size_t size) const
+        {
+            Header header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, "CWGRAPH", 8);
+            header.version = VERSION;
+            header.kind = kind;
+            header.length = length;
+            header.encoding = encoding;
+            header.dictionaryHash = dictionaryHash;
+
+            uint64_t h = 0xcbf29ce484222325ULL;
+            for(size_t i = 0; i < size; ++i)
+                h = (h ^ (unsigned char) data[i]) * 0x100000001b3ULL;
+            header.checksum = h;
+            return header;
+        }
+
+        std::string path(GraphKind kind, size_t length, IndexEncoding encoding) const
+        {
+            std::ostringstream os;
+            os << directory << "/" << GRAPH_KIND_NAMES[kind] << "-" << length
+               << (encoding == INDEX_SYMBOL ? "-symbol-" : "-channel-")
+               << std::hex << std::setw(16) << std::setfill('0') << dictionaryHash << ".dfa";
+            return os.str();
+        }
+
+        std::string directory;
+        uint64_t dictionaryHash;
+};
 
+// The automata of a grid, built on demand. A graph is identified by its
+// kind and line length, so the H and V variants of a square grid are the
+// same graph and are built once. Prefetch() builds the graphs a model needs
+// concurrently; any graph requested without having been prefetched is built
+// by the first caller that asks for it. Graphs are dropped once converted,
+// only the Gecode DFAs are kept.
 class DictionaryDFA
 {
     public:
-        DictionaryDFA(const Dictionary &dict, size_t width, size_t height):
-            dictionary(dict)
+        // Graph builds, loads and conversions are recorded in statistics,
+        // if given
+        DictionaryDFA(const Dictionary &dict, size_t width, size_t height, IndexEncoding encoding = INDEX_SYMBOL, const std::string &cacheDirectory = "", RunStatistics *statistics = nullptr):
+            dictionary(dict),
+            width(width),
+            height(height),
+            encoding(encoding),
+            cache(cacheDirectory, cacheDirectory.empty() ? 0 : dict.Hash()),
+            statistics(statistics)
         {
-            std::cout << "DFA initialization..." << std::endl;
+        }
 
-            // Border H
-            borderH.MakeBorder(dict, width);
+        // Starts building the given (kind, length) graphs in parallel
+        void Prefetch(const std::vector<std::pair<GraphKind, size_t> > &graphs) const
+        {
+            for(const auto &graph : graphs)
+                entry(graph.first, graph.second, true);
+        }
 
-            // Border V
-            borderV.MakeBorder(dict, height);
+        // The graphs used by the Crosswords model
+        void PrefetchModel() const
+        {
+            Prefetch({{GRAPH_FIRST, width}, {GRAPH_FIRST, height}, {GRAPH_SECOND, width}, {GRAPH_SECOND, height}});
+        }
 
-            // First H/V
-            firstH.MakeFirst(dict, width);
-            firstV.MakeFirst(dict, height);
-            
-            // Second H/V
-            secondH.MakeSecond(dict, width);
-            secondV.MakeSecond(dict, height);
+        // The graphs used by the slot model
+        void PrefetchLines() const
+        {
+            Prefetch({{GRAPH_LINE, width}, {GRAPH_LINE, height}});
+        }
+
+        size_t Width() const
+        {
+            return width;
+        }
 
-            std::cout << "DFA initialized!" << std::endl;
+        size_t Height() const
+        {
+            return height;
+        }
+
+        // Waits for every prefetched graph
+        void Wait() const
+        {
+            std::vector<Automaton> pending;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for(const auto &it : automata)
+                    pending.push_back(it.second);
+            }
+            for(auto &automaton : pending)
+                automaton.wait();
+        }
+
+        // States and transitions of the graphs built so far
+        void Size(size_t &states, size_t &transitions) const
+        {
+            states = transitions = 0;
+            std::lock_guard<std::mutex> lock(mutex);
+            for(const auto &it : automata)
+            {
+                if(it.second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                    continue;
+                states += it.second.get()->n_states();
+                transitions += it.second.get()->n_transitions();
+            }
         }
 
         Gecode::DFA *BorderH() const
         {
-            return borderH.ToGecodeAlloc();
+            return get(GRAPH_BORDER, width);
         }
 
         Gecode::DFA *BorderV() const
         {
-            return borderV.ToGecodeAlloc();
+            return get(GRAPH_BORDER, height);
         }
 
         Gecode::DFA *FirstH() const
         {
-            return firstH.ToGecodeAlloc();
+            return get(GRAPH_FIRST, width);
         }
 
         Gecode::DFA *FirstV() const
         {
-            return firstV.ToGecodeAlloc();
+            return get(GRAPH_FIRST, height);
         }
 
         Gecode::DFA *SecondH() const
         {
-            return secondH.ToGecodeAlloc();
+            return get(GRAPH_SECOND, width);
         }
 
         Gecode::DFA *SecondV() const
         {
-            return secondV.ToGecodeAlloc();
+            return get(GRAPH_SECOND, height);
+        }
+
+        // Handle on the shared automaton of a graph, built on first use
+        Gecode::DFA Get(GraphKind kind, size_t length) const
+        {
+            return *entry(kind, length, false).get();
         }
 
     protected:
+        typedef std::shared_future<std::shared_ptr<const Gecode::DFA> > Automaton;
+
+        Automaton entry(GraphKind kind, size_t length, bool async) const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto key = std::make_pair(kind, length);
+            auto it = automata.find(key);
+            if(it == automata.end())
+            {
+                auto policy = async ? std::launch::async : std::launch::deferred;
+                it = automata.emplace(key, std::async(policy, &DictionaryDFA::make, this, kind, length).share()).first;
+            }
+            return it->second;
+        }
+
+        // Returns a new handle on the shared automaton, to be deleted by the
+        // caller
+        Gecode::DFA *get(GraphKind kind, size_t length) const
+        {
+            return new Gecode::DFA(*entry(kind, length, false).get());
+        }
+
+        std::shared_ptr<const Gecode::DFA> make(GraphKind kind, size_t length) const
+        {
+            const std::string name = std::string(GRAPH_KIND_NAMES[kind]) + " " + std::to_string(length);
+            Graph graph;
+            PhaseTimer build(statistics, "graph load " + name);
+            if(!cache.Load(kind, length, encoding, graph))
+            {
+                build.Rename("graph build " + name);
+                switch(kind)
+                {
+                    case GRAPH_BORDER:
+                        graph.MakeBorder(dictionary, length, encoding);
+                        break;
+                    case GRAPH_FIRST:
+                        graph.MakeFirst(dictionary, length, encoding);
+                        break;
+                    case GRAPH_SECOND:
+                        graph.MakeSecond(dictionary, length, encoding);
+                        break;
+                    case GRAPH_LINE:
+                        graph.MakeLine(dictionary, length);
+                        break;
+                }
+
+                cache.Store(kind, length, encoding, graph);
+            }
+            build.Stop();
+
+            PhaseTimer conversion(statistics, "gecode conversion " + name);
+            return std::shared_ptr<const Gecode::DFA>(graph.ToGecodeAlloc());
+        }
 
         const Dictionary &dictionary;
+        size_t width;
+        size_t height;
+        IndexEncoding encoding;
+        DFACache cache;
+        RunStatistics *statistics;
+
+        // Declared last: destroying it waits for the builds in flight, which
+        // use the members above
+        mutable std::mutex mutex;
+        mutable std::map<std::pair<GraphKind, size_t>, Automaton> automata;
+};
+
+// Keeps the DictionaryDFA of the capacity most recently used grid sizes,
+// so that one process can serve several sizes without rebuilding their
+// automata. Evicted sizes stay alive as long as a search still uses them.
+class AutomataCache
+{
+    public:
+        AutomataCache(const Dictionary &dict, size_t capacity, IndexEncoding encoding = INDEX_SYMBOL, const std::string &cacheDirectory = "", RunStatistics *statistics = nullptr):
+            dictionary(dict),
+            capacity(std::max<size_t>(1, capacity)),
+            encoding(encoding),
+            cacheDirectory(cacheDirectory),
+            statistics(statistics)
+        {
+        }
+
+        // The automata of a grid size; the caller prefetches the graphs its
+        // model needs
+        std::shared_ptr<const DictionaryDFA> Get(size_t width, size_t height)
+        {
+            // Released after the lock: destroying automata waits for their
+            // builds in flight
+            std::shared_ptr<const DictionaryDFA> evicted;
 
-        Graph borderH;
-        Graph borderV;
-        Graph firstH;
-        Graph firstV;
-        Graph secondH;
-        Graph secondV;
+            std::lock_guard<std::mutex> lock(mutex);
+            auto key = std::make_pair(width, height);
+            for(auto it = entries.begin(); it != entries.end(); ++it)
+            {
+                if(it->first == key)
+                {
+                    entries.splice(entries.begin(), entries, it);
+                    return it->second;
+                }
+            }
+
+            auto automata = std::make_shared<DictionaryDFA>(dictionary, width, height, encoding, cacheDirectory, statistics);
+            entries.emplace_front(key, automata);
+            if(entries.size() > capacity)
+            {
+                evicted = entries.back().second;
+                entries.pop_back();
+            }
+            return automata;
+        }
+
+    protected:
+        const Dictionary &dictionary;
+        size_t capacity;
+        IndexEncoding encoding;
+        std::string cacheDirectory;
+        RunStatistics *statistics;
+
+        std::mutex mutex;
+        // Most recently used first
+        std::list<std::pair<std::pair<size_t, size_t>, std::shared_ptr<const DictionaryDFA> > > entries;
 };
 
 #endif
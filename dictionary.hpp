@@ -2,27 +2,162 @@
 #define DICTIONARY_HPP
 
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <set>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 const size_t MIN_INDEX = 256;
 
+// Words of a text dictionary may be followed by ';' and a score from 0
+// (obscure) to MAX_WORD_SCORE, words without one get DEFAULT_WORD_SCORE
+const int MAX_WORD_SCORE = 100;
+const int DEFAULT_WORD_SCORE = 50;
+
+// Words are stored contiguously in a single character arena, sorted by
+// length first and alphabetically second. Word indices are MIN_INDEX+1 for
+// the first word of length 2, and then follow the arena order, so that
+// both index -> word and length -> first index are plain array lookups.
+//
+// A dictionary can be compiled with Save() into a binary file holding
+// exactly that layout, which the constructor then maps read-only instead
+// of parsing: loading is zero-copy and the pages are shared between all
+// the processes that map the same file.
+//
+// Binary layout (native endianness):
+//   BinaryHeader
+//   uint32_t bucketStarts[header.maxlen]
+//   uint32_t offsets[header.wordCount + 1]
+//   char     chars[header.charCount]
+//   uint8_t  scores[header.wordCount]
+const char DICTIONARY_MAGIC[8] = {'C', 'W', 'D', 'I', 'C', 'T', 0, 2};
+
 class Dictionary
 {
     public:
-        Dictionary(const std::string &filename, size_t maxlen)
+        class Collection
+        {
+            public:
+                class const_iterator
+                {
+                    public:
+                        const_iterator(const Dictionary &dict, size_t position):
+                            dictionary(&dict),
+                            position(position)
+                        {
+                        }
+
+                        std::string_view operator*() const
+                        {
+                            return dictionary->wordAt(position);
+                        }
+
+                        const_iterator &operator++()
+                        {
+                            ++position;
+                            return *this;
+                        }
+
+                        bool operator!=(const const_iterator &other) const
+                        {
+                            return position != other.position;
+                        }
+
+                    private:
+                        const Dictionary *dictionary;
+                        size_t position;
+                };
+
+                Collection(const Dictionary &dict, size_t first, size_t last):
+                    dictionary(dict),
+                    first(first),
+                    last(last)
+                {
+                }
+
+                const_iterator begin() const
+                {
+                    return const_iterator(dictionary, first);
+                }
+
+                const_iterator end() const
+                {
+                    return const_iterator(dictionary, last);
+                }
+
+                size_t size() const
+                {
+                    return last - first;
+                }
+
+            private:
+                const Dictionary &dictionary;
+                size_t first;
+                size_t last;
+        };
+
+        Dictionary(const std::string &filename, size_t maxlen):
+            maxlen(maxlen),
+            mapping(nullptr),
+            mappingSize(0)
         {
+            if(mapBinary(filename))
+                return;
+
             std::ifstream file(filename);
-            std::string line;
+            std::stringstream buffer;
+            buffer << file.rdbuf();
+            const std::string contents = buffer.str();
 
-            collections.resize(maxlen-1);
+            std::vector<Entry> words;
+            splitLines(contents, words);
+            build(words);
+        }
 
-            while(std::getline(file, line))
-            {
-                if(line.size() >= 2 && line.size() <= maxlen)
-                    collections[line.size()-2].insert(line);
-            }
+        Dictionary(const Dictionary &) = delete;
+        Dictionary &operator=(const Dictionary &) = delete;
+
+        ~Dictionary()
+        {
+            unmap();
+        }
+
+        // Writes the binary form of the dictionary, see the layout above
+        bool Save(const std::string &filename) const
+        {
+            std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+            if(!file)
+                return false;
+
+            BinaryHeader header;
+            std::memcpy(header.magic, DICTIONARY_MAGIC, sizeof(header.magic));
+            header.maxlen = maxlen;
+            header.wordCount = WordCount();
+            header.charCount = offsetData[WordCount()];
+            header.reserved = 0;
+
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(bucketStarts.data()), maxlen * sizeof(uint32_t));
+            file.write(reinterpret_cast<const char*>(offsetData), (WordCount()+1) * sizeof(uint32_t));
+            file.write(charData, header.charCount);
+            file.write(reinterpret_cast<const char*>(scoreData), WordCount());
+
+            return file.good();
+        }
+
+        static bool IsBinary(const std::string &filename)
+        {
+            std::ifstream file(filename, std::ios::binary);
+            char magic[sizeof(DICTIONARY_MAGIC)];
+            return file.read(magic, sizeof(magic)) && std::memcmp(magic, DICTIONARY_MAGIC, sizeof(magic)) == 0;
         }
 
         void AddMandatoryWords(const std::string &filename, size_t maxlen, std::vector<int> &indices)
@@ -32,67 +167,348 @@ class Dictionary
             std::ifstream file(filename);
             std::string line;
 
+            bool missing = false;
             while(std::getline(file, line))
             {
                 if(line.size() >= 2 && line.size() <= maxlen)
                 {
-                    collections[line.size()-2].insert(line);
                     tosearch.push_back(line);
+                    missing = missing || IndexOfWord(line) < 0;
                 }
             }
 
+            // Rebuild the arena with the new words merged in, with the
+            // default score
+            if(missing)
+                rebuild(std::vector<char>(WordCount(), 1), tosearch);
+
             indices.clear();
             for(const auto &s : tosearch)
                 indices.push_back(IndexOfWord(s));
         }
 
+        // Drops the words whose flag is 0, keep[i] being the flag of the
+        // word of index MIN_INDEX+1+i. Returns the number of words dropped.
+        size_t Retain(const std::vector<char> &keep)
+        {
+            const size_t before = WordCount();
+            rebuild(keep, std::vector<std::string>());
+            return before - WordCount();
+        }
+
         int FirstIndexOfLength(size_t length) const
         {
-            size_t index = MIN_INDEX+1;
-            length -= 2;
-            for(size_t i = 0; i < length; ++i)
-                index += collections[i].size();
-            return index;
+            return MIN_INDEX + 1 + bucketStarts[length-2];
         }
-        
+
         int LastIndexOfLength(size_t length) const
         {
-            return FirstIndexOfLength(length) + collections[length-2].size()-1;
+            return MIN_INDEX + bucketStarts[length-1];
         }
 
-        const std::set<std::string> &GetCollection(size_t length) const
+        Collection GetCollection(size_t length) const
         {
-            return collections[length-2];
+            return Collection(*this, bucketStarts[length-2], bucketStarts[length-1]);
         }
 
-        // Assumes that word does exist
-        int IndexOfWord(const std::string &word) const
+        // Returns -1 if word does not exist
+        int IndexOfWord(std::string_view word) const
         {
-            int baseIndex = FirstIndexOfLength(word.size());
-            const auto &collection = collections[word.size()-2];
-            size_t i = 0;
+            if(word.size() < 2 || word.size() > maxlen)
+                return -1;
 
-            for(std::set<std::string>::const_iterator it = collection.cbegin(); it != collection.cend() && *it != word; ++it, ++i);
+            size_t first = bucketStarts[word.size()-2];
+            size_t last = bucketStarts[word.size()-1];
 
-            return baseIndex + i;
+            // Binary search within the bucket of words of the same length
+            while(first < last)
+            {
+                size_t middle = first + (last - first) / 2;
+                if(wordAt(middle) < word)
+                    first = middle + 1;
+                else
+                    last = middle;
+            }
+
+            if(first < bucketStarts[word.size()-1] && wordAt(first) == word)
+                return MIN_INDEX + 1 + first;
+            return -1;
+        }
+
+        std::string_view GetWord(size_t index) const
+        {
+            return wordAt(index - MIN_INDEX - 1);
         }
 
-        std::string GetWord(size_t index) const
+        int GetScore(size_t index) const
         {
-            size_t ind = MIN_INDEX;
-            size_t i = 0;
+            return scoreData[index - MIN_INDEX - 1];
+        }
 
-            while(ind + collections[i].size() < index)
-                ind += collections[i++].size();
+        size_t WordCount() const
+        {
+            return wordCount;
+        }
 
-            auto it = collections[i].begin();
-            for(size_t j = ind+1; j < index; ++j)
-                ++it;
-            return *it;
+        size_t MaxLength() const
+        {
+            return maxlen;
+        }
+
+        // Content hash (FNV-1a) of the words and their order, used to key
+        // caches of structures derived from the dictionary. Scores are left
+        // out, no automaton depends on them.
+        uint64_t Hash() const
+        {
+            return hash;
         }
 
     protected:
-        std::vector<std::set<std::string> > collections;
+        struct BinaryHeader
+        {
+            char magic[8];
+            uint32_t maxlen;
+            uint32_t wordCount;
+            uint32_t charCount;
+            uint32_t reserved;
+        };
+
+        struct Entry
+        {
+            std::string_view word;
+            uint8_t score;
+        };
+
+        std::string_view wordAt(size_t position) const
+        {
+            return std::string_view(charData + offsetData[position], offsetData[position+1] - offsetData[position]);
+        }
+
+        bool mapBinary(const std::string &filename)
+        {
+            int fd = open(filename.c_str(), O_RDONLY);
+            if(fd < 0)
+                return false;
+
+            struct stat st;
+            if(fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(BinaryHeader))
+            {
+                close(fd);
+                return false;
+            }
+
+            void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if(addr == MAP_FAILED)
+                return false;
+
+            const char *base = static_cast<const char*>(addr);
+            BinaryHeader header;
+            std::memcpy(&header, base, sizeof(header));
+
+            size_t expected = sizeof(header)
+                            + header.maxlen * sizeof(uint32_t)
+                            + (header.wordCount + (size_t) 1) * sizeof(uint32_t)
+                            + header.charCount
+                            + header.wordCount;
+            if(std::memcmp(header.magic, DICTIONARY_MAGIC, sizeof(header.magic)) != 0
+            || header.maxlen < 1 || (size_t) st.st_size < expected)
+            {
+                munmap(addr, st.st_size);
+                return false;
+            }
+
+            // Buckets and offsets index the arenas: a corrupt file must not
+            // send any lookup out of them
+            const uint32_t *fileBuckets = reinterpret_cast<const uint32_t*>(base + sizeof(header));
+            const uint32_t *fileOffsets = fileBuckets + header.maxlen;
+            bool consistent = fileOffsets[header.wordCount] == header.charCount;
+            for(uint32_t i = 0; i < header.maxlen && consistent; ++i)
+                consistent = fileBuckets[i] <= header.wordCount && (i == 0 || fileBuckets[i-1] <= fileBuckets[i]);
+            for(uint32_t i = 0; i < header.wordCount && consistent; ++i)
+                consistent = fileOffsets[i] <= fileOffsets[i+1];
+            // Every word has the length of its bucket, which the word
+            // supports index letter by letter
+            consistent = consistent && fileBuckets[0] == 0 && fileBuckets[header.maxlen-1] == header.wordCount;
+            for(uint32_t length = 2; length <= header.maxlen && consistent; ++length)
+            {
+                for(uint32_t i = fileBuckets[length-2]; i < fileBuckets[length-1] && consistent; ++i)
+                    consistent = fileOffsets[i+1] - fileOffsets[i] == length;
+            }
+            if(!consistent)
+            {
+                munmap(addr, st.st_size);
+                return false;
+            }
+
+            mapping = addr;
+            mappingSize = st.st_size;
+
+            offsetData = fileOffsets;
+            charData = reinterpret_cast<const char*>(offsetData + header.wordCount + 1);
+            scoreData = reinterpret_cast<const uint8_t*>(charData + header.charCount);
+
+            // Lengths beyond what the file holds are empty buckets, lengths
+            // beyond maxlen are simply cut off the end of the mapped arena
+            bucketStarts.resize(maxlen);
+            for(size_t length = 2; length <= maxlen+1; ++length)
+                bucketStarts[length-2] = length-2 < header.maxlen ? fileBuckets[length-2] : header.wordCount;
+            wordCount = bucketStarts[maxlen-1];
+            hash = computeHash();
+
+            return true;
+        }
+
+        // Computed once the words are in place, see Hash()
+        uint64_t computeHash() const
+        {
+            uint64_t h = 0xcbf29ce484222325ULL;
+            auto mix = [&h](const char *data, size_t size) {
+                for(size_t i = 0; i < size; ++i)
+                    h = (h ^ (unsigned char) data[i]) * 0x100000001b3ULL;
+            };
+
+            mix(reinterpret_cast<const char*>(bucketStarts.data()), bucketStarts.size() * sizeof(uint32_t));
+            mix(reinterpret_cast<const char*>(offsetData), (wordCount+1) * sizeof(uint32_t));
+            mix(charData, offsetData[wordCount]);
+            return h;
+        }
+
+        void unmap()
+        {
+            if(mapping)
+                munmap(mapping, mappingSize);
+            mapping = nullptr;
+            mappingSize = 0;
+        }
+
+        // Builds the arena again from the kept words and the extra ones
+        void rebuild(const std::vector<char> &keep, const std::vector<std::string> &extra)
+        {
+            // build() must not read from the storage it is replacing
+            const std::string oldChars = std::move(chars);
+            const std::vector<uint32_t> oldOffsets = std::move(offsets);
+            const std::vector<uint8_t> oldScores = std::move(scores);
+            const char *oldCharData = mapping ? charData : oldChars.data();
+            const uint32_t *oldOffsetData = mapping ? offsetData : oldOffsets.data();
+            const uint8_t *oldScoreData = mapping ? scoreData : oldScores.data();
+
+            std::vector<Entry> words;
+            words.reserve(WordCount() + extra.size());
+            for(size_t i = 0; i < WordCount(); ++i)
+            {
+                if(keep[i])
+                    words.push_back(Entry{std::string_view(oldCharData + oldOffsetData[i], oldOffsetData[i+1] - oldOffsetData[i]), oldScoreData[i]});
+            }
+            for(const auto &s : extra)
+                words.push_back(Entry{s, DEFAULT_WORD_SCORE});
+
+            build(words);
+            unmap();
+        }
+
+        // One word per line, optionally followed by ';' and its score
+        void splitLines(std::string_view contents, std::vector<Entry> &words) const
+        {
+            size_t start = 0;
+            while(start < contents.size())
+            {
+                size_t end = contents.find('\n', start);
+                if(end == std::string_view::npos)
+                    end = contents.size();
+                std::string_view line = contents.substr(start, end - start);
+                start = end + 1;
+
+                int score = DEFAULT_WORD_SCORE;
+                size_t separator = line.find(';');
+                if(separator != std::string_view::npos)
+                {
+                    std::string_view digits = line.substr(separator + 1);
+                    if(!digits.empty() && digits.find_first_not_of("0123456789") == std::string_view::npos)
+                    {
+                        score = 0;
+                        for(char c : digits)
+                            score = std::min(MAX_WORD_SCORE, score*10 + (c - '0'));
+                    }
+                    line = line.substr(0, separator);
+                }
+                words.push_back(Entry{line, (uint8_t) score});
+            }
+        }
+
+        // Sorts, deduplicates (keeping the best score) and packs words into
+        // the arena
+        void build(std::vector<Entry> &words)
+        {
+            words.erase(std::remove_if(words.begin(), words.end(), [this](const Entry &e) {
+                return e.word.size() < 2 || e.word.size() > maxlen;
+            }), words.end());
+
+            std::sort(words.begin(), words.end(), [](const Entry &a, const Entry &b) {
+                if(a.word.size() != b.word.size())
+                    return a.word.size() < b.word.size();
+                return a.word < b.word || (a.word == b.word && a.score > b.score);
+            });
+            words.erase(std::unique(words.begin(), words.end(), [](const Entry &a, const Entry &b) {
+                return a.word == b.word;
+            }), words.end());
+
+            size_t charCount = 0;
+            for(const auto &e : words)
+                charCount += e.word.size();
+
+            std::string newChars;
+            newChars.reserve(charCount);
+            offsets.clear();
+            offsets.reserve(words.size() + 1);
+            scores.clear();
+            scores.reserve(words.size());
+            bucketStarts.assign(maxlen, 0);
+
+            for(size_t i = 0; i < words.size(); ++i)
+            {
+                offsets.push_back(newChars.size());
+                newChars.append(words[i].word);
+                scores.push_back(words[i].score);
+            }
+            offsets.push_back(newChars.size());
+
+            // bucketStarts[length-2] is the arena position of the first word
+            // of the given length; the extra last entry is the word count
+            size_t position = 0;
+            for(size_t length = 2; length <= maxlen+1; ++length)
+            {
+                while(position < words.size() && words[position].word.size() < length)
+                    ++position;
+                bucketStarts[length-2] = position;
+            }
+
+            chars = std::move(newChars);
+            charData = chars.data();
+            offsetData = offsets.data();
+            scoreData = scores.data();
+            wordCount = words.size();
+            hash = computeHash();
+        }
+
+        size_t maxlen;
+
+        // Owned storage, used unless the dictionary is memory-mapped
+        std::string chars;
+        std::vector<uint32_t> offsets;
+        std::vector<uint8_t> scores;
+
+        void *mapping;
+        size_t mappingSize;
+
+        // Either point to the owned storage or into the mapping
+        const char *charData;
+        const uint32_t *offsetData;
+        const uint8_t *scoreData;
+        size_t wordCount;
+        uint64_t hash;
+
+        std::vector<uint32_t> bucketStarts;
 };
 
 #endif
@@ -0,0 +1,110 @@
+#ifndef DIVERSITY_HPP
+#define DIVERSITY_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Set of the grids emitted so far, shared by all the workers of a batch,
+// which rejects grids sharing too many words with one of them.
+//
+// A grid is fingerprinted by the set of its word indices. An inverted
+// index maps each word to the grids that use it, so that the overlap of a
+// candidate with every emitted grid costs one pass over the postings of
+// its own words. The index is split in shards by word, each with its own
+// lock: workers only contend when their candidates share words, and a
+// candidate locks just the shards of its words, in shard order.
+class GridRegistry
+{
+    public:
+        // A candidate is rejected when more than maxOverlap percent of its
+        // words appear in a single emitted grid; identical grids are always
+        // rejected
+        explicit GridRegistry(unsigned int maxOverlap, size_t shardCount = 64):
+            maxOverlap(maxOverlap),
+            shards(shardCount),
+            grids(0),
+            rejected(0)
+        {
+        }
+
+        // Registers the grid unless it overlaps too much with an emitted one
+        bool TryAdd(std::vector<int> words)
+        {
+            std::sort(words.begin(), words.end());
+            words.erase(std::unique(words.begin(), words.end()), words.end());
+
+            std::vector<size_t> locked;
+            for(int word : words)
+                locked.push_back(shardOf(word));
+            std::sort(locked.begin(), locked.end());
+            locked.erase(std::unique(locked.begin(), locked.end()), locked.end());
+
+            for(size_t shard : locked)
+                shards[shard].mutex.lock();
+
+            // Shared words with each emitted grid
+            std::unordered_map<size_t, size_t> shared;
+            bool accept = true;
+            for(int word : words)
+            {
+                const Shard &shard = shards[shardOf(word)];
+                auto postings = shard.postings.find(word);
+                if(postings == shard.postings.end())
+                    continue;
+                for(size_t grid : postings->second)
+                {
+                    size_t common = ++shared[grid];
+                    if(common == words.size() || common * 100 > maxOverlap * words.size())
+                        accept = false;
+                }
+                if(!accept)
+                    break;
+            }
+
+            if(accept)
+            {
+                size_t id = grids++;
+                for(int word : words)
+                    shards[shardOf(word)].postings[word].push_back(id);
+            }
+            else
+                ++rejected;
+
+            for(size_t shard : locked)
+                shards[shard].mutex.unlock();
+
+            return accept;
+        }
+
+        size_t GridCount() const
+        {
+            return grids;
+        }
+
+        size_t RejectedCount() const
+        {
+            return rejected;
+        }
+
+    private:
+        struct Shard
+        {
+            std::mutex mutex;
+            std::unordered_map<int, std::vector<size_t>> postings;
+        };
+
+        size_t shardOf(int word) const
+        {
+            return (size_t) word % shards.size();
+        }
+
+        unsigned int maxOverlap;
+        std::vector<Shard> shards;
+        std::atomic<size_t> grids;
+        std::atomic<size_t> rejected;
+};
+
+#endif
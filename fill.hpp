@@ -0,0 +1,327 @@
+#ifndef FILL_HPP
+#define FILL_HPP
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dictionary.hpp"
+#include "pattern.hpp"
+#include "stop.hpp"
+
+// For each word length, one bitset over the words of that length per
+// (position, letter): bit i of Letter(length, k, c) is set when the i-th
+// word of that length has letter c at position k. The candidates of a
+// partially filled slot are then the AND of the bitsets of its known
+// letters, a loop over plain 64-bit blocks that the compiler vectorizes.
+class WordBitsets
+{
+    public:
+        WordBitsets(const Dictionary &dict, size_t maxlen):
+            dictionary(dict),
+            buckets(maxlen + 1)
+        {
+            for(size_t length = 2; length <= maxlen && length <= dict.MaxLength(); ++length)
+            {
+                Bucket &bucket = buckets[length];
+                const auto words = dict.GetCollection(length);
+                bucket.count = words.size();
+                bucket.blocks = (bucket.count + 63) / 64;
+                bucket.letters.assign(length * LETTERS * bucket.blocks, 0);
+                bucket.valid.assign(bucket.blocks, 0);
+
+                size_t i = 0;
+                for(const auto &word : words)
+                {
+                    // Words with other characters never fit a grid
+                    bool valid = true;
+                    for(char c : word)
+                        valid = valid && c >= 'a' && c <= 'z';
+                    if(valid)
+                    {
+                        bucket.valid[i / 64] |= (uint64_t) 1 << (i % 64);
+                        for(size_t k = 0; k < length; ++k)
+                            bucket.letters[(k * LETTERS + word[k] - 'a') * bucket.blocks + i / 64] |= (uint64_t) 1 << (i % 64);
+                    }
+                    ++i;
+                }
+            }
+        }
+
+        size_t Blocks(size_t length) const
+        {
+            return buckets[length].blocks;
+        }
+
+        const uint64_t *Valid(size_t length) const
+        {
+            return buckets[length].valid.data();
+        }
+
+        const uint64_t *Letter(size_t length, size_t position, char letter) const
+        {
+            const Bucket &bucket = buckets[length];
+            return bucket.letters.data() + (position * LETTERS + letter - 'a') * bucket.blocks;
+        }
+
+        // The i-th word of the given length
+        std::string_view Word(size_t length, size_t i) const
+        {
+            return dictionary.GetWord(dictionary.FirstIndexOfLength(length) + i);
+        }
+
+    private:
+        static const size_t LETTERS = 26;
+
+        struct Bucket
+        {
+            Bucket():
+                count(0),
+                blocks(0)
+            {
+            }
+
+            size_t count;
+            size_t blocks;
+            std::vector<uint64_t> letters;
+            std::vector<uint64_t> valid;
+        };
+
+        const Dictionary &dictionary;
+        std::vector<Bucket> buckets;
+};
+
+// Fills the slots of a pattern with distinct words, without Gecode: slots
+// are filled most-constrained first by chronological backtracking, and a
+// word is only tried if every crossing slot keeps at least one candidate.
+// Slot candidate counts are cached and only recomputed for the slots
+// crossing the last filled one. One engine is used by one thread; several
+// engines with different seeds can share the same bitsets.
+class FillEngine
+{
+    public:
+        FillEngine(const WordBitsets &bits, const Pattern &pattern):
+            bits(bits),
+            pattern(pattern),
+            width(pattern.Width()),
+            height(pattern.Height())
+        {
+            const auto &slots = pattern.Slots();
+            std::vector<std::vector<std::pair<size_t, size_t> > > owners(width * height);
+            for(size_t s = 0; s < slots.size(); ++s)
+            {
+                for(size_t k = 0; k < slots[s].length; ++k)
+                    owners[cell(s, k)].emplace_back(s, k);
+            }
+
+            crossings.resize(slots.size());
+            for(size_t s = 0; s < slots.size(); ++s)
+            {
+                for(size_t k = 0; k < slots[s].length; ++k)
+                {
+                    for(const auto &owner : owners[cell(s, k)])
+                    {
+                        if(owner.first != s)
+                            crossings[s].push_back(owner.first);
+                    }
+                }
+            }
+        }
+
+        // Fills the pattern, returns false when stopped, after cutoff nodes
+        // (0: no cutoff) or when no fill exists (see Exhausted). rows gets
+        // the grid, '{' for black tiles.
+        bool Solve(unsigned int seed, const StopToken &stop, std::vector<std::string> &rows, unsigned long cutoff = 0)
+        {
+            const auto &slots = pattern.Slots();
+            rng.seed(seed);
+            stopToken = &stop;
+            nodeCutoff = cutoff;
+            nodes = 0;
+            aborted = false;
+
+            grid.assign(width * height, 0);
+            filled.assign(slots.size(), false);
+            used.clear();
+            for(size_t length = 0; length <= std::max(width, height); ++length)
+                used.emplace_back(length >= 2 ? bits.Blocks(length) : 0, 0);
+
+            size_t maxBlocks = 0;
+            for(const auto &slot : slots)
+                maxBlocks = std::max(maxBlocks, bits.Blocks(slot.length));
+            candidates.assign(slots.size() + 1, std::vector<uint64_t>(maxBlocks));
+            counts.assign(slots.size() + 1, std::vector<size_t>(slots.size()));
+            for(size_t s = 0; s < slots.size(); ++s)
+                counts[0][s] = candidateCount(s, candidates[0].data());
+
+            if(!search(0))
+                return false;
+
+            rows.assign(height, std::string(width, ' '));
+            for(size_t y = 0; y < height; ++y)
+            {
+                for(size_t x = 0; x < width; ++x)
+                {
+                    size_t c = x + y*width;
+                    if(pattern.IsBlack(c))
+                        rows[y][x] = 'z'+1;
+                    else
+                        rows[y][x] = grid[c] ? grid[c] : 'a' + rng() % 26; // Outside of any slot
+                }
+            }
+            return true;
+        }
+
+        // Whether the last failed Solve explored the whole search space
+        bool Exhausted() const
+        {
+            return !aborted;
+        }
+
+        // Nodes of the last Solve
+        unsigned long Nodes() const
+        {
+            return nodes;
+        }
+
+    private:
+        size_t cell(size_t slot, size_t k) const
+        {
+            const auto &s = pattern.Slots()[slot];
+            return s.start + k*s.step;
+        }
+
+        // Writes the unused words fitting the known letters of the slot,
+        // returns their number
+        size_t candidateCount(size_t slot, uint64_t *out) const
+        {
+            const size_t length = pattern.Slots()[slot].length;
+            const size_t blocks = bits.Blocks(length);
+            const uint64_t *valid = bits.Valid(length);
+            const uint64_t *taken = used[length].data();
+            for(size_t b = 0; b < blocks; ++b)
+                out[b] = valid[b] & ~taken[b];
+
+            for(size_t k = 0; k < length; ++k)
+            {
+                char letter = grid[cell(slot, k)];
+                if(!letter)
+                    continue;
+                const uint64_t *mask = bits.Letter(length, k, letter);
+                for(size_t b = 0; b < blocks; ++b)
+                    out[b] &= mask[b];
+            }
+
+            size_t count = 0;
+            for(size_t b = 0; b < blocks; ++b)
+                count += __builtin_popcountll(out[b]);
+            return count;
+        }
+
+        bool search(size_t depth)
+        {
+            ++nodes;
+            if((nodeCutoff && nodes >= nodeCutoff) || ((nodes & 1023) == 0 && stopToken->Stopped()))
+                aborted = true;
+            if(aborted)
+                return false;
+
+            // Most constrained slot, ties broken at random
+            const auto &slots = pattern.Slots();
+            size_t best = slots.size();
+            size_t ties = 0;
+            for(size_t s = 0; s < slots.size(); ++s)
+            {
+                if(filled[s])
+                    continue;
+                if(best == slots.size() || counts[depth][s] < counts[depth][best])
+                {
+                    best = s;
+                    ties = 1;
+                }
+                else if(counts[depth][s] == counts[depth][best] && rng() % ++ties == 0)
+                    best = s;
+            }
+            if(best == slots.size())
+                return true;
+
+            const size_t length = slots[best].length;
+            const size_t blocks = bits.Blocks(length);
+            uint64_t *words = candidates[depth].data();
+            if(!candidateCount(best, words))
+                return false;
+
+            // Candidates in order from a random block, so that seeds give
+            // different grids
+            std::string previous(length, 0);
+            const size_t offset = rng() % blocks;
+            for(size_t n = 0; n < blocks; ++n)
+            {
+                size_t b = (offset + n) % blocks;
+                for(uint64_t block = words[b]; block; block &= block - 1)
+                {
+                    size_t i = b*64 + __builtin_ctzll(block);
+                    std::string_view word = bits.Word(length, i);
+
+                    for(size_t k = 0; k < length; ++k)
+                    {
+                        previous[k] = grid[cell(best, k)];
+                        grid[cell(best, k)] = word[k];
+                    }
+                    filled[best] = true;
+                    used[length][i / 64] |= (uint64_t) 1 << (i % 64);
+
+                    bool viable = true;
+                    counts[depth+1] = counts[depth];
+                    for(size_t other : crossings[best])
+                    {
+                        if(filled[other])
+                            continue;
+                        counts[depth+1][other] = candidateCount(other, candidates[depth+1].data());
+                        if(!counts[depth+1][other])
+                        {
+                            viable = false;
+                            break;
+                        }
+                    }
+
+                    if(viable && search(depth+1))
+                        return true;
+
+                    used[length][i / 64] &= ~((uint64_t) 1 << (i % 64));
+                    filled[best] = false;
+                    for(size_t k = 0; k < length; ++k)
+                        grid[cell(best, k)] = previous[k];
+
+                    if(aborted)
+                        return false;
+                }
+            }
+            return false;
+        }
+
+        const WordBitsets &bits;
+        const Pattern &pattern;
+        size_t width;
+        size_t height;
+        // Slots sharing a cell with each slot
+        std::vector<std::vector<size_t> > crossings;
+
+        std::mt19937 rng;
+        const StopToken *stopToken;
+        unsigned long nodeCutoff;
+        unsigned long nodes;
+        bool aborted;
+
+        // Letters, 0 when unknown
+        std::string grid;
+        std::vector<bool> filled;
+        // Words in use, per length
+        std::vector<std::vector<uint64_t> > used;
+        // Per search depth
+        std::vector<std::vector<uint64_t> > candidates;
+        std::vector<std::vector<size_t> > counts;
+};
+
+#endif
@@ -0,0 +1,369 @@
+#ifndef JSON_HPP
+#define JSON_HPP
+
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+// Just enough JSON for the requests and replies of the generator: a value
+// tree parsed from a string, and quoting for the output side
+class JsonValue
+{
+    public:
+        enum Type
+        {
+            JSON_NULL,
+            JSON_BOOL,
+            JSON_NUMBER,
+            JSON_STRING,
+            JSON_ARRAY,
+            JSON_OBJECT
+        };
+
+        JsonValue():
+            type(JSON_NULL),
+            boolean(false),
+            number(0)
+        {
+        }
+
+        // Returns false (with error set) if text is not a single JSON value
+        static bool Parse(std::string_view text, JsonValue &value, std::string &error)
+        {
+            Parser parser{text, 0, error};
+            if(!parser.value(value, 0))
+                return false;
+            parser.skipSpaces();
+            if(parser.position != text.size())
+                return parser.fail("trailing characters");
+            return true;
+        }
+
+        static std::string Quote(std::string_view s)
+        {
+            std::string quoted = "\"";
+            for(char c : s)
+            {
+                if(c == '"' || c == '\\')
+                    quoted += '\\';
+                if((unsigned char) c < 0x20)
+                {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int) c);
+                    quoted += escaped;
+                }
+                else
+                    quoted += c;
+            }
+            return quoted + '"';
+        }
+
+        Type GetType() const
+        {
+            return type;
+        }
+
+        bool IsBool() const
+        {
+            return type == JSON_BOOL;
+        }
+
+        bool IsNumber() const
+        {
+            return type == JSON_NUMBER;
+        }
+
+        bool IsString() const
+        {
+            return type == JSON_STRING;
+        }
+
+        bool IsArray() const
+        {
+            return type == JSON_ARRAY;
+        }
+
+        bool IsObject() const
+        {
+            return type == JSON_OBJECT;
+        }
+
+        bool Bool() const
+        {
+            return boolean;
+        }
+
+        double Number() const
+        {
+            return number;
+        }
+
+        const std::string &String() const
+        {
+            return string;
+        }
+
+        const std::vector<JsonValue> &Array() const
+        {
+            return array;
+        }
+
+        // Null value if the member is missing
+        const JsonValue &operator[](const std::string &key) const
+        {
+            static const JsonValue none;
+            auto it = object.find(key);
+            return it == object.end() ? none : *it->second;
+        }
+
+        bool Has(const std::string &key) const
+        {
+            return object.count(key) > 0;
+        }
+
+        // Compact serialization, e.g. to echo a request field back
+        std::string Dump() const
+        {
+            switch(type)
+            {
+                case JSON_BOOL:
+                    return boolean ? "true" : "false";
+                case JSON_NUMBER:
+                {
+                    char buffer[32];
+                    std::snprintf(buffer, sizeof(buffer), "%.17g", number);
+                    return buffer;
+                }
+                case JSON_STRING:
+                    return Quote(string);
+                case JSON_ARRAY:
+                {
+                    std::string out = "[";
+                    for(size_t i = 0; i < array.size(); ++i)
+                        out += (i ? "," : "") + array[i].Dump();
+                    return out + "]";
+                }
+                case JSON_OBJECT:
+                {
+                    std::string out = "{";
+                    for(const auto &member : object)
+                        out += (out.size() > 1 ? "," : "") + Quote(member.first) + ":" + member.second->Dump();
+                    return out + "}";
+                }
+                default:
+                    return "null";
+            }
+        }
+
+    private:
+        // Bounds the nesting depth, requests are flat
+        static const int MAX_DEPTH = 64;
+
+        struct Parser
+        {
+            std::string_view text;
+            size_t position;
+            std::string &error;
+
+            bool fail(const std::string &what)
+            {
+                error = what + " at offset " + std::to_string(position);
+                return false;
+            }
+
+            void skipSpaces()
+            {
+                while(position < text.size() && (text[position] == ' ' || text[position] == '\t'
+                                              || text[position] == '\n' || text[position] == '\r'))
+                    ++position;
+            }
+
+            bool literal(std::string_view word)
+            {
+                if(text.substr(position, word.size()) != word)
+                    return fail("invalid literal");
+                position += word.size();
+                return true;
+            }
+
+            bool value(JsonValue &out, int depth)
+            {
+                if(depth > MAX_DEPTH)
+                    return fail("too deeply nested");
+
+                skipSpaces();
+                if(position >= text.size())
+                    return fail("unexpected end");
+
+                char c = text[position];
+                if(c == '{')
+                    return parseObject(out, depth);
+                if(c == '[')
+                    return parseArray(out, depth);
+                if(c == '"')
+                {
+                    out.type = JSON_STRING;
+                    return parseString(out.string);
+                }
+                if(c == 't' || c == 'f')
+                {
+                    out.type = JSON_BOOL;
+                    out.boolean = c == 't';
+                    return literal(c == 't' ? "true" : "false");
+                }
+                if(c == 'n')
+                {
+                    out.type = JSON_NULL;
+                    return literal("null");
+                }
+                return parseNumber(out);
+            }
+
+            bool parseNumber(JsonValue &out)
+            {
+                // strtod needs a terminated buffer
+                size_t end = position;
+                while(end < text.size() && std::string_view("+-0123456789.eE").find(text[end]) != std::string_view::npos)
+                    ++end;
+                std::string digits(text.substr(position, end - position));
+                char *stop = nullptr;
+                out.number = std::strtod(digits.c_str(), &stop);
+                if(digits.empty() || stop != digits.c_str() + digits.size())
+                    return fail("invalid number");
+                out.type = JSON_NUMBER;
+                position = end;
+                return true;
+            }
+
+            bool parseString(std::string &out)
+            {
+                ++position; // opening quote
+                while(position < text.size())
+                {
+                    char c = text[position++];
+                    if(c == '"')
+                        return true;
+                    if(c != '\\')
+                    {
+                        out += c;
+                        continue;
+                    }
+
+                    if(position >= text.size())
+                        break;
+                    char escaped = text[position++];
+                    switch(escaped)
+                    {
+                        case 'b': out += '\b'; break;
+                        case 'f': out += '\f'; break;
+                        case 'n': out += '\n'; break;
+                        case 'r': out += '\r'; break;
+                        case 't': out += '\t'; break;
+                        case 'u':
+                        {
+                            if(position + 4 > text.size())
+                                return fail("invalid escape");
+                            std::string hex(text.substr(position, 4));
+                            char *stop = nullptr;
+                            unsigned long code = std::strtoul(hex.c_str(), &stop, 16);
+                            if(stop != hex.c_str() + 4)
+                                return fail("invalid escape");
+                            position += 4;
+                            // Words are plain bytes, only the ASCII range is kept as is
+                            out += code < 0x80 ? (char) code : '?';
+                            break;
+                        }
+                        default:
+                            out += escaped;
+                            break;
+                    }
+                }
+                return fail("unterminated string");
+            }
+
+            bool parseArray(JsonValue &out, int depth)
+            {
+                out.type = JSON_ARRAY;
+                ++position;
+                skipSpaces();
+                if(position < text.size() && text[position] == ']')
+                {
+                    ++position;
+                    return true;
+                }
+
+                while(true)
+                {
+                    out.array.emplace_back();
+                    if(!value(out.array.back(), depth+1))
+                        return false;
+                    skipSpaces();
+                    if(position < text.size() && text[position] == ',')
+                        ++position;
+                    else if(position < text.size() && text[position] == ']')
+                    {
+                        ++position;
+                        return true;
+                    }
+                    else
+                        return fail("expected , or ]");
+                }
+            }
+
+            bool parseObject(JsonValue &out, int depth)
+            {
+                out.type = JSON_OBJECT;
+                ++position;
+                skipSpaces();
+                if(position < text.size() && text[position] == '}')
+                {
+                    ++position;
+                    return true;
+                }
+
+                while(true)
+                {
+                    skipSpaces();
+                    if(position >= text.size() || text[position] != '"')
+                        return fail("expected a member name");
+                    std::string key;
+                    if(!parseString(key))
+                        return false;
+                    skipSpaces();
+                    if(position >= text.size() || text[position] != ':')
+                        return fail("expected :");
+                    ++position;
+                    // A repeated member replaces the earlier one
+                    std::unique_ptr<JsonValue> &member = out.object[key];
+                    member.reset(new JsonValue());
+                    if(!value(*member, depth+1))
+                        return false;
+                    skipSpaces();
+                    if(position < text.size() && text[position] == ',')
+                        ++position;
+                    else if(position < text.size() && text[position] == '}')
+                    {
+                        ++position;
+                        return true;
+                    }
+                    else
+                        return fail("expected , or }");
+                }
+            }
+        };
+
+        Type type;
+        bool boolean;
+        double number;
+        std::string string;
+        // std::vector may hold an incomplete type, std::map may not: the
+        // members are held through pointers
+        std::vector<JsonValue> array;
+        std::map<std::string, std::unique_ptr<JsonValue> > object;
+};
+
+#endif
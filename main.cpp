@@ -1,45 +1,168 @@
 #include <iostream>
+#include <fstream>
 #include <ctime>
 #include <vector>
 #include <algorithm>
 #include <thread>
 #include <mutex>
+#include <string>
+#include <cstdint>
+#include <memory>
+#include <filesystem>
+#include <chrono>
+#include <atomic>
+#include <cmath>
+#include <limits>
 
 #include <gecode/driver.hh>
 #include <gecode/int.hh>
 
 #include "dictionary.hpp"
 #include "dfa.hpp"
+#include "wordchannel.hpp"
+#include "options.hpp"
+#include "scheduler.hpp"
+#include "stop.hpp"
+#include "diversity.hpp"
+#include "json.hpp"
+#include "daemon.hpp"
+#include "pattern.hpp"
+#include "fill.hpp"
+#include "wordtable.hpp"
+#include "prune.hpp"
+#include "stats.hpp"
+#include "score.hpp"
 
 using namespace Gecode;
 
-const size_t WIDTH = 9;
-const size_t HEIGHT = 11;
-static Dictionary dictionary("dict", HEIGHT);
+const bool FANCY_BORDERS = false;
 
-static DFA * dfa_borderH;
-static DFA * dfa_borderV;
-static DFA * dfa_firstH;
-static DFA * dfa_firstV;
-static DFA * dfa_secondH;
-static DFA * dfa_secondV;
+// Prefer the precompiled dictionary, unless the plain text one is newer
+// or it was compiled by another version
+static std::string dictionary_path()
+{
+    std::error_code ec;
+    auto binTime = std::filesystem::last_write_time("dict.bin", ec);
+    if(ec)
+        return "dict";
+    if(!Dictionary::IsBinary("dict.bin"))
+    {
+        std::cerr << "dict.bin was compiled by another version, using dict (run --compile-dict again)" << std::endl;
+        return "dict";
+    }
+    auto textTime = std::filesystem::last_write_time("dict", ec);
+    if(!ec && textTime > binTime)
+        return "dict";
+    return "dict.bin";
+}
+
+// Loaded once settings are known, with the longest words any grid size
+// may need
+static std::unique_ptr<Dictionary> dictionary;
+static std::unique_ptr<AutomataCache> automataCache;
+// Word supports of each length, for the native engine, the table
+// propagation and the word channels
+static std::unique_ptr<WordBitsets> wordBitsets;
+// Word values of --optimize quality
+static std::unique_ptr<WordValues> wordValues;
+
+static Settings settings;
+static StopToken stopToken;
+static RunStatistics statistics;
 
 static std::mutex cout_mutex;
 
+// Variable selection for the first words
+enum WordOrder
+{
+    ORDER_SIZE,   // smallest domain first
+    ORDER_AFC,    // most failures (accumulated) per domain size first
+    ORDER_ACTION, // most recently pruned per domain size first
+    ORDER_DEGREE, // most constrained per domain size first
+    ORDER_COUNT
+};
+
+const char *const WORD_ORDER_NAMES[ORDER_COUNT] = {"size", "afc", "action", "degree"};
+
+// How one search branches. Members of a portfolio differ in their
+// strategy, id is their rank in it (-1 outside of a portfolio).
+struct Strategy
+{
+    Strategy():
+        seed(settings.seed ? settings.seed : std::time(nullptr)),
+        order(ORDER_SIZE),
+        id(-1)
+    {
+    }
+
+    unsigned int seed;
+    WordOrder order;
+    int id;
+};
+
+// Words of a grid given as rows, '{' for black tiles: the runs of at least
+// 2 letters, rows first then columns
+void grid_wordlist(const std::vector<std::string> &lines, std::vector<std::string> &words)
+{
+    words.clear();
+    const size_t height = lines.size();
+    const size_t width = height ? lines[0].size() : 0;
+
+    for(int vertical = 0; vertical < 2; ++vertical)
+    {
+        for(size_t i = 0; i < (vertical ? width : height); ++i)
+        {
+            std::string tmp = "";
+            for(size_t j = 0; j < (vertical ? height : width); ++j)
+            {
+                char c = vertical ? lines[j][i] : lines[i][j];
+                if(c != 'z'+1)
+                    tmp += c;
+                else
+                {
+                    if(tmp.size() >= 2)
+                        words.push_back(tmp);
+                    tmp = "";
+                }
+            }
+            if(tmp.size() >= 2)
+                words.push_back(tmp);
+        }
+    }
+}
+
+// The grid then its words, whichever engine filled it
+void print_grid(std::ostream &os, const std::vector<std::string> &lines)
+{
+    for(const auto &line : lines)
+        os << line << std::endl;
+    os << std::endl;
+
+    std::vector<std::string> words;
+    grid_wordlist(lines, words);
+    for(const auto &word : words)
+        os << word << std::endl;
+}
+
+// Selects the slot model constructor of Crosswords
+struct SlotModel
+{
+};
+
 class Crosswords: public Script
 {
     public:
-        Crosswords(const SizeOptions &opt, size_t width, size_t height, bool fancyBorders, const std::vector<int> &orderedMandatory = std::vector<int>()):
+        Crosswords(const SizeOptions &opt, const DictionaryDFA &automata, bool fancyBorders, const std::vector<int> &orderedMandatory = std::vector<int>(), const std::vector<int> &requiredWords = std::vector<int>(), const Strategy &strategy = Strategy()):
             Script(opt),
-            width(width),
-            height(height),
+            width(automata.Width()),
+            height(automata.Height()),
 
             letters(*this, width * height, 'a', 'z'+1), // Letters go from 'a' to 'z', and black tile is 'z'+1 ('{')
 
-            ind1H(*this, height, dictionary.FirstIndexOfLength(2), dictionary.LastIndexOfLength(width)),
-            ind2H(*this, height, MIN_INDEX, dictionary.LastIndexOfLength(width-3)),
-            ind1V(*this, width, dictionary.FirstIndexOfLength(2), dictionary.LastIndexOfLength(height)),
-            ind2V(*this, width, MIN_INDEX, dictionary.LastIndexOfLength(height-3)),
+            ind1H(*this, height, dictionary->FirstIndexOfLength(2), dictionary->LastIndexOfLength(width)),
+            ind2H(*this, height, MIN_INDEX, dictionary->LastIndexOfLength(width-3)),
+            ind1V(*this, width, dictionary->FirstIndexOfLength(2), dictionary->LastIndexOfLength(height)),
+            ind2V(*this, width, MIN_INDEX, dictionary->LastIndexOfLength(height-3)),
             
             wordPos1H(*this, height, 0, 2),
             wordPos2H(*this, height, 3, width+1),
@@ -47,13 +170,19 @@ class Crosswords: public Script
             wordPos2V(*this, width, 3, height+1),
 
             wordLen1H(*this, height, 2, width),
-            wordLen1V(*this, width, 2, height)
+            wordLen1V(*this, width, 2, height),
+            relaxSeed(strategy.seed)
         {
             // Fewer black tiles than X
             count(*this, letters, 'z'+1, IRT_LQ, 10); // <= 10
 
             auto allIndices = ind1H+ind2H+ind1V+ind2V;
 
+            const DFA firstH = automata.Get(GRAPH_FIRST, width);
+            const DFA firstV = automata.Get(GRAPH_FIRST, height);
+            const DFA secondH = automata.Get(GRAPH_SECOND, width);
+            const DFA secondV = automata.Get(GRAPH_SECOND, height);
+
             distinct(*this, allIndices, MIN_INDEX);
 
             /* Borders */
@@ -84,16 +213,29 @@ class Crosswords: public Script
                     rel(*this, allIndices[i], IRT_EQ, index);
             }
 
+            postRequired(allIndices, requiredWords);
+            postObjective(allIndices);
+
             // Horizontal words
             for(size_t y = 0; y < height; ++y)
             {
                 // First words
                 IntVarArgs row = letters.slice(y*width, 1, width);
-                extensional(*this, wordPos1H[y] + row + ind1H[y] + wordLen1H[y], *dfa_firstH);
-
                 // Second words
                 IntVarArgs reducedRow = letters.slice(y*width+3, 1, width-3);
-                extensional(*this, wordPos2H[y] + reducedRow + ind2H[y], *dfa_secondH);
+
+                if(settings.encoding == INDEX_SYMBOL)
+                {
+                    extensional(*this, wordPos1H[y] + row + ind1H[y] + wordLen1H[y], firstH);
+                    extensional(*this, wordPos2H[y] + reducedRow + ind2H[y], secondH);
+                }
+                else
+                {
+                    extensional(*this, wordPos1H[y] + row + wordLen1H[y], firstH);
+                    wordchannel(*this, row, wordPos1H[y], 0, ind1H[y], wordLen1H[y], INT_MAX, *wordBitsets, *dictionary);
+                    extensional(*this, wordPos2H[y] + reducedRow, secondH);
+                    wordchannel(*this, reducedRow, wordPos2H[y], 3, ind2H[y], IntVar(*this, 0, width-3), width-1, *wordBitsets, *dictionary);
+                }
 
                 // wp2H[y] == wp1H[y] + wl1H[y] + 1
                 // wp2H[y] * 1 + wp1H[y] * (-1) + wl1H[y] * (-1) == 1
@@ -105,28 +247,223 @@ class Crosswords: public Script
             {
                 // First words
                 IntVarArgs col = letters.slice(x, width, height);
-                extensional(*this, wordPos1V[x] + col + ind1V[x] + wordLen1V[x], *dfa_firstV);
-
                 // Second words
                 IntVarArgs reducedCol = letters.slice(x+3*width, width, height-3);
-                extensional(*this, wordPos2V[x] + reducedCol + ind2V[x], *dfa_secondV);
+
+                if(settings.encoding == INDEX_SYMBOL)
+                {
+                    extensional(*this, wordPos1V[x] + col + ind1V[x] + wordLen1V[x], firstV);
+                    extensional(*this, wordPos2V[x] + reducedCol + ind2V[x], secondV);
+                }
+                else
+                {
+                    extensional(*this, wordPos1V[x] + col + wordLen1V[x], firstV);
+                    wordchannel(*this, col, wordPos1V[x], 0, ind1V[x], wordLen1V[x], INT_MAX, *wordBitsets, *dictionary);
+                    extensional(*this, wordPos2V[x] + reducedCol, secondV);
+                    wordchannel(*this, reducedCol, wordPos2V[x], 3, ind2V[x], IntVar(*this, 0, height-3), height-1, *wordBitsets, *dictionary);
+                }
 
                 // wp2V[x] == wp1V[x] + wl1V[x] + 1
                 // wp2V[y] * 1 + wp1V[x] * (-1) + wl1V[x] * (-1) == 1
                 linear(*this, std::vector<int> {1, -1, -1}, std::vector<IntVar> {wordPos2V[x], wordPos1V[x], wordLen1V[x]}, IRT_EQ, 1);
             }
 
-            auto seed = std::time(nullptr);
-            branch(*this, ind1H+ind1V, INT_VAR_SIZE_MIN(), INT_VAL_RND(seed));
+            Rnd seed(strategy.seed);
+            if(requiredWords.size())
+                branch(*this, requiredSlots, INT_VAR_SIZE_MIN(), INT_VAL_RND(seed));
+            branchWords(ind1H+ind1V, strategy.order, seed);
             branch(*this, ind2H+ind2V, INT_VAR_NONE(), INT_VAL_RND(seed));
 
             branch(*this, wordPos1H+wordPos1V, INT_VAR_NONE(), INT_VAL_MIN());
         }
 
+        // Any number of words per row and column. Each line gets the line
+        // automaton and one slot per word it may hold, (length+1)/3 since
+        // words take at least 2 letters and a black tile. Slot j of a line
+        // is present when its position is in [0, length-2], absent ones sit
+        // at length+1+j, so that present slots come first and in order.
+        // Slots are bound to the runs of letters by counting the cells that
+        // start a run of at least 2 letters, which present slots must all
+        // start on.
+        Crosswords(const SizeOptions &opt, const DictionaryDFA &automata, const SlotModel &, const std::vector<int> &requiredWords = std::vector<int>(), const Strategy &strategy = Strategy()):
+            Script(opt),
+            width(automata.Width()),
+            height(automata.Height()),
+
+            letters(*this, width * height, 'a', 'z'+1),
+            relaxSeed(strategy.seed)
+        {
+            // Black tiles are the easy way out of every dead end: without a
+            // cap, search settles for short words split by many of them
+            count(*this, letters, 'z'+1, IRT_LQ, (width * height * settings.maxBlacks + 50) / 100);
+
+            BoolVarArgs black(width * height);
+            for(size_t cell = 0; cell < width * height; ++cell)
+            {
+                black[cell] = BoolVar(*this, 0, 1);
+                rel(*this, letters[cell], IRT_EQ, 'z'+1, black[cell]);
+            }
+
+            const DFA lineH = automata.Get(GRAPH_LINE, width);
+            const DFA lineV = automata.Get(GRAPH_LINE, height);
+
+            IntVarArgs indices, positions;
+            auto line = [&](size_t first, size_t step, size_t length, const DFA &dfa) {
+                IntVarArgs cells(length);
+                BoolVarArgs cellBlack(length);
+                for(size_t k = 0; k < length; ++k)
+                {
+                    cells[k] = letters[first + k*step];
+                    cellBlack[k] = black[first + k*step];
+                }
+                extensional(*this, cells, dfa);
+
+                // starts[k] for the cells that start a run of at least 2
+                // letters, padded for the positions of absent slots
+                const size_t slotCount = (length + 1) / 3;
+                BoolVarArgs starts(length + 1 + slotCount);
+                for(size_t k = 0; k + 1 < length; ++k)
+                {
+                    starts[k] = BoolVar(*this, 0, 1);
+                    BoolVarArgs before;
+                    if(k > 0)
+                        before << cellBlack[k-1];
+                    clause(*this, BOT_AND, before, BoolVarArgs({cellBlack[k], cellBlack[k+1]}), starts[k]);
+                }
+                starts[length-1] = BoolVar(*this, 0, 0);
+                starts[length] = BoolVar(*this, 0, 0);
+
+                IntArgs coefficients;
+                BoolVarArgs counted;
+                for(size_t k = 0; k + 1 < length; ++k)
+                {
+                    coefficients << 1;
+                    counted << starts[k];
+                }
+
+                IntVar previousPos, previousLen;
+                for(size_t j = 0; j < slotCount; ++j)
+                {
+                    starts[length+1+j] = BoolVar(*this, 1, 1);
+
+                    std::vector<int> values;
+                    for(size_t k = 0; k + 1 < length; ++k)
+                        values.push_back(k);
+                    values.push_back(length+1+j);
+                    IntVar pos(*this, IntSet(values));
+                    IntVar len(*this, 0, length);
+                    IntVar ind(*this, MIN_INDEX, dictionary->LastIndexOfLength(length));
+                    wordchannel(*this, cells, pos, 0, ind, len, length-1, *wordBitsets, *dictionary);
+                    element(*this, starts, pos, 1);
+
+                    BoolVar present(*this, 0, 1);
+                    rel(*this, pos, IRT_LQ, length-2, present);
+                    coefficients << -1;
+                    counted << present;
+
+                    // pos >= previousPos + previousLen + 1
+                    if(j > 0)
+                        linear(*this, IntArgs({1, -1, -1}), IntVarArgs({pos, previousPos, previousLen}), IRT_GQ, 1);
+
+                    previousPos = pos;
+                    previousLen = len;
+                    positions << pos;
+                    indices << ind;
+                }
+
+                // As many present slots as runs
+                linear(*this, coefficients, counted, IRT_EQ, 0);
+            };
+
+            for(size_t y = 0; y < height; ++y)
+                line(y*width, 1, width, lineH);
+            for(size_t x = 0; x < width; ++x)
+                line(x, width, height, lineV);
+
+            slots = IntVarArray(*this, indices);
+            distinct(*this, slots, MIN_INDEX);
+            postRequired(slots, requiredWords);
+            postObjective(slots);
+
+            Rnd seed(strategy.seed);
+            if(requiredWords.size())
+                branch(*this, requiredSlots, INT_VAR_SIZE_MIN(), INT_VAL_RND(seed));
+            branchWords(slots, strategy.order, seed);
+            branch(*this, positions, INT_VAR_NONE(), INT_VAL_MIN());
+            // Letters outside of any word
+            branch(*this, letters, INT_VAR_NONE(), INT_VAL_RND(seed));
+        }
+
+        // Fixed black tiles: one exact-length word per slot of the pattern,
+        // whose size must match the automata
+        Crosswords(const SizeOptions &opt, const DictionaryDFA &automata, const Pattern &pattern, const std::vector<int> &requiredWords = std::vector<int>(), const Strategy &strategy = Strategy()):
+            Script(opt),
+            width(automata.Width()),
+            height(automata.Height()),
+
+            letters(*this, width * height, 'a', 'z'+1),
+            relaxSeed(strategy.seed)
+        {
+            for(size_t cell = 0; cell < width * height; ++cell)
+                rel(*this, letters[cell], pattern.IsBlack(cell) ? IRT_EQ : IRT_NQ, 'z'+1);
+
+            const auto &patternSlots = pattern.Slots();
+            IntVarArgs indices(patternSlots.size());
+            for(size_t i = 0; i < patternSlots.size(); ++i)
+            {
+                const auto &slot = patternSlots[i];
+                indices[i] = IntVar(*this, dictionary->FirstIndexOfLength(slot.length), dictionary->LastIndexOfLength(slot.length));
+
+                IntVarArgs word(slot.length);
+                for(size_t k = 0; k < slot.length; ++k)
+                    word[k] = letters[slot.start + k*slot.step];
+
+                if(settings.propagation == PROPAGATION_TABLE)
+                {
+                    wordtable(*this, word, indices[i], *wordBitsets, *dictionary);
+                    continue;
+                }
+
+                const DFA exact = automata.Get(GRAPH_BORDER, slot.length);
+                if(settings.encoding == INDEX_SYMBOL)
+                    extensional(*this, word + indices[i], exact);
+                else
+                {
+                    extensional(*this, word, exact);
+                    wordchannel(*this, word, IntVar(*this, 0, 0), 0, indices[i], IntVar(*this, slot.length, slot.length), INT_MAX, *wordBitsets, *dictionary);
+                }
+            }
+            slots = IntVarArray(*this, indices);
+
+            // Words of different lengths never collide: one distinct per
+            // length, acting only once a slot is fixed
+            for(size_t length = 2; length <= std::max(width, height); ++length)
+            {
+                IntVarArgs sameLength;
+                for(size_t i = 0; i < patternSlots.size(); ++i)
+                {
+                    if(patternSlots[i].length == length)
+                        sameLength << slots[i];
+                }
+                if(sameLength.size() > 1)
+                    distinct(*this, sameLength, IPL_VAL);
+            }
+            postRequired(slots, requiredWords);
+            postObjective(slots);
+
+            Rnd seed(strategy.seed);
+            if(requiredWords.size())
+                branch(*this, requiredSlots, INT_VAR_SIZE_MIN(), INT_VAL_RND(seed));
+            branchWords(slots, strategy.order, seed);
+            // Letters outside of any slot
+            branch(*this, letters, INT_VAR_NONE(), INT_VAL_RND(seed));
+        }
+
         Crosswords(Crosswords &crosswords):
             Script(crosswords),
             width(crosswords.width),
-            height(crosswords.height)
+            height(crosswords.height),
+            relaxSeed(crosswords.relaxSeed)
         {
             letters.update(*this, crosswords.letters);
 
@@ -142,6 +479,12 @@ class Crosswords: public Script
 
             wordLen1H.update(*this, crosswords.wordLen1H);
             wordLen1V.update(*this, crosswords.wordLen1V);
+
+            requiredSlots.update(*this, crosswords.requiredSlots);
+
+            slots.update(*this, crosswords.slots);
+
+            objective.update(*this, crosswords.objective);
         }
 
         virtual Space *copy(void)
@@ -149,80 +492,165 @@ class Crosswords: public Script
             return new Crosswords(*this);
         }
 
-        virtual void print(std::ostream &os) const
+        // Branch and bound (--optimize): better than best from now on
+        virtual void constrain(const Space &best)
+        {
+            rel(*this, objective, IRT_GR, static_cast<const Crosswords &>(best).objective.val());
+        }
+
+        // Called on the master space before each restart. Unless
+        // optimizing, there is no objective, so unlike the default the last
+        // solution does not constrain the next ones; only the no-goods of
+        // the previous run (none unless Search::Options::nogoods_limit is
+        // set) are kept.
+        virtual bool master(const MetaInfo &mi)
         {
+            if(mi.type() == MetaInfo::RESTART)
+            {
+                if(settings.optimize != OPTIMIZE_NONE && mi.last())
+                    constrain(*mi.last());
+                mi.nogoods().post(*this);
+                return true;
+            }
+            return Script::master(mi);
+        }
+
+        // Every restart searches the whole model, except when optimizing
+        // around a grid: the letters of the best grid so far are then kept
+        // outside of a random window covering --relax percent of the grid
+        virtual bool slave(const MetaInfo &mi)
+        {
+            if(settings.optimize == OPTIMIZE_NONE || mi.type() != MetaInfo::RESTART || !mi.last())
+                return true;
+
+            const Crosswords &best = static_cast<const Crosswords &>(*mi.last());
+            const double side = std::sqrt(settings.relax / 100.0);
+            const size_t w = std::min(width, std::max<size_t>(1, std::lround(width * side)));
+            const size_t h = std::min(height, std::max<size_t>(1, std::lround(height * side)));
+            Rnd rnd(relaxSeed + mi.restart());
+            const size_t left = rnd(width - w + 1);
+            const size_t top = rnd(height - h + 1);
+
             for(size_t y = 0; y < height; ++y)
             {
                 for(size_t x = 0; x < width; ++x)
                 {
-                    auto var = letters[x+y*width];
-                    if(var.min() != var.max())
-                        os << '?';
-                    else
-                    {
-                        char c = var.val();
-                        os << c;
-                    }
+                    if(x >= left && x < left + w && y >= top && y < top + h)
+                        continue;
+                    auto var = best.letters[x+y*width];
+                    if(var.assigned())
+                        rel(*this, letters[x+y*width], IRT_EQ, var.val());
                 }
-                os << std::endl;
             }
-            os << std::endl;
+            return false;
+        }
 
-            std::vector<std::string> words;
-            wordlist(words);
-            for(const auto word : words)
-                std::cout << word << std::endl;
+        // The value --optimize maximizes, once solved
+        int Objective() const
+        {
+            return objective.val();
         }
-        
-        virtual void wordlist(std::vector<std::string> &words) const
+
+        virtual void print(std::ostream &os) const
         {
-            words.clear();
+            std::vector<std::string> lines;
+            rows(lines);
+            print_grid(os, lines);
+        }
 
+        // One line per row, black tiles included
+        void rows(std::vector<std::string> &lines) const
+        {
+            lines.assign(height, std::string(width, '?'));
             for(size_t y = 0; y < height; ++y)
             {
-                std::string tmp = "";
                 for(size_t x = 0; x < width; ++x)
                 {
                     auto var = letters[x+y*width];
-                    if(var.min() != var.max())
-                        tmp += '?';
-                    else if(var.val() != 'z'+1)
-                        tmp += var.val();
-                    else
-                    {
-                        if(tmp.size() >= 2)
-                            words.push_back(tmp);
-                        tmp = "";
-                    }
+                    if(var.assigned())
+                        lines[y][x] = var.val();
                 }
-                if(tmp.size() >= 2)
-                    words.push_back(tmp);
             }
+        }
 
-            for(size_t x = 0; x < width; ++x)
+        // Dictionary indices of the words of the grid
+        void indices(std::vector<int> &words) const
+        {
+            words.clear();
+            for(auto array : {&ind1H, &ind2H, &ind1V, &ind2V, &slots})
             {
-                std::string tmp = "";
-                for(size_t y = 0; y < height; ++y)
+                for(int i = 0; i < array->size(); ++i)
                 {
-                    auto var = letters[x+y*width];
-                    if(var.min() != var.max())
-                        tmp += '?';
-                    else if(var.val() != 'z'+1)
-                        tmp += var.val();
-                    else
-                    {
-                        if(tmp.size() >= 2)
-                            words.push_back(tmp);
-                        tmp = "";
-                    }
+                    if((*array)[i].assigned() && (*array)[i].val() != (int) MIN_INDEX)
+                        words.push_back((*array)[i].val());
                 }
-
-                if(tmp.size() >= 2)
-                    words.push_back(tmp);
             }
         }
 
+        virtual void wordlist(std::vector<std::string> &words) const
+        {
+            std::vector<std::string> lines;
+            rows(lines);
+            grid_wordlist(lines, words);
+        }
+
     protected:
+        // Words that must appear anywhere in the grid:
+        // words[requiredSlots[m]] == requiredWords[m]
+        void postRequired(const IntVarArgs &words, const std::vector<int> &requiredWords)
+        {
+            requiredSlots = IntVarArray(*this, requiredWords.size(), 0, words.size()-1);
+            for(size_t m = 0; m < requiredWords.size(); ++m)
+            {
+                element(*this, words, requiredSlots[m], requiredWords[m]);
+                count(*this, words, requiredWords[m], IRT_EQ, 1);
+            }
+        }
+
+        // The value --optimize maximizes, from the word index variables of
+        // the model: the quality of the words, or minus the number of black
+        // tiles
+        void postObjective(const IntVarArgs &words)
+        {
+            switch(settings.optimize)
+            {
+                case OPTIMIZE_QUALITY:
+                    objective = IntVar(*this, 0, wordValues->Limit(words.size()));
+                    wordscore(*this, words, objective, *wordValues);
+                    break;
+                case OPTIMIZE_BLACKS:
+                {
+                    objective = IntVar(*this, -(int) (width * height), 0);
+                    IntVar blacks(*this, 0, width * height);
+                    count(*this, letters, 'z'+1, IRT_EQ, blacks);
+                    linear(*this, IntArgs({1, 1}), IntVarArgs({objective, blacks}), IRT_EQ, 0);
+                    break;
+                }
+                default:
+                    objective = IntVar(*this, 0, 0);
+                    break;
+            }
+        }
+
+        void branchWords(const IntVarArgs &words, WordOrder order, Rnd seed)
+        {
+            switch(order)
+            {
+                case ORDER_AFC:
+                    branch(*this, words, INT_VAR_AFC_SIZE_MAX(0.99), INT_VAL_RND(seed));
+                    break;
+                case ORDER_ACTION:
+                    branch(*this, words, INT_VAR_ACTION_SIZE_MAX(0.99), INT_VAL_RND(seed));
+                    break;
+                case ORDER_DEGREE:
+                    branch(*this, words, INT_VAR_DEGREE_SIZE_MAX(), INT_VAL_RND(seed));
+                    break;
+                default:
+                    branch(*this, words, INT_VAR_SIZE_MIN(), INT_VAL_RND(seed));
+                    break;
+            }
+        }
+
         size_t width;
         size_t height;
         IntVarArray letters;
@@ -239,104 +667,345 @@ class Crosswords: public Script
 
         IntVarArray wordLen1H;
         IntVarArray wordLen1V;
+
+        IntVarArray requiredSlots;
+
+        // Word of each slot, in pattern mode only
+        IntVarArray slots;
+
+        IntVar objective;
+        // Seed of the neighbourhoods of the optimization
+        unsigned int relaxSeed;
 };
 
-bool permutation_valid(size_t width, size_t height, bool fancyBorders, const std::vector<int> &indices)
+static Pattern pattern;
+
+// The pattern model when a pattern of that size was given, otherwise the
+// model chosen by --model
+std::unique_ptr<Crosswords> make_model(const SizeOptions &opt, const DictionaryDFA &automata, bool fancyBorders, const std::vector<int> &orderedMandatory, const std::vector<int> &requiredWords, const Strategy &strategy)
 {
-    // Assumes order: ind1H(H) + ind2H(H)
-    //              + ind1V(W) + ind2V(W);
+    if(!pattern.Empty() && pattern.Width() == automata.Width() && pattern.Height() == automata.Height())
+        return std::unique_ptr<Crosswords>(new Crosswords(opt, automata, pattern, requiredWords, strategy));
+    if(settings.model == MODEL_SLOTS)
+        return std::unique_ptr<Crosswords>(new Crosswords(opt, automata, SlotModel(), requiredWords, strategy));
+    return std::unique_ptr<Crosswords>(new Crosswords(opt, automata, fancyBorders, orderedMandatory, requiredWords, strategy));
+}
 
-    for(size_t i = 0; i < indices.size(); ++i)
+// Checks the word placed in slot i against the grid size and against the
+// other slots it interacts with, as long as they come before i.
+// Slots are ordered: ind1H(H) + ind2H(H)
+//                  + ind1V(W) + ind2V(W);
+// and 0 means that the slot is not imposed.
+bool slot_valid(size_t width, size_t height, bool fancyBorders, const std::vector<int> &indices, size_t i)
+{
+    int index = indices[i];
+    if(!index)
+        return true;
+
+    size_t size = dictionary->GetWord(index).size();
+
+    if(fancyBorders)
     {
-        int index = indices[i];
-        if(index)
-        {
-            std::string word = dictionary.GetWord(index);
-            size_t size = word.size();
+        if((i == 0 || i == height-1) && size != width)
+            return false;
+        if((i == 2*height || i == 2*height+width-1) && size != height)
+            return false;
+    }
 
-            if(fancyBorders)
-            {
-                if((i == 0 || i == height-1) && size != width)
-                    return false;
-                if((i == 2*height || i == 2*height+width-1) && size != height)
-                    return false;
-            }
+    if(i < height) // ind1H
+        return size <= width;
+    else if(i < 2*height) // ind2H
+    {
+        int other = indices[i - height];
+        return size + 3 <= width
+            && (!other || size+dictionary->GetWord(other).size()+1 <= width);
+    }
+    else if(i < 2*height + width) // ind1V
+        return size <= height;
+    else // ind2V
+    {
+        int other = indices[i - width];
+        return size + 3 <= height
+            && (!other || size+dictionary->GetWord(other).size()+1 <= height);
+    }
+}
 
-            if(i < height) // ind1H
-            {
-                if(size > width)
-                    return false;
-                
-                int other = indices[i + height];
-                if(other && size+dictionary.GetWord(other).size()+1 > width)
-                    return false;
-            }
-            else if(i < 2*height) // ind2H
-            {
-                if(size + 3 > width)
-                    return false;
-            }
-            else if(i < 2*height + width) // ind1V
-            {
-                if(size > height)
-                    return false;
-                
-                int other = indices[i + width];
-                if(other && size+dictionary.GetWord(other).size()+1 > height)
-                    return false;
-            }
-            else // ind2V
+Search::Cutoff *make_cutoff()
+{
+    switch(settings.restart)
+    {
+        case RESTART_LUBY:
+            return Search::Cutoff::luby(settings.restartScale);
+        case RESTART_GEOMETRIC:
+            return Search::Cutoff::geometric(settings.restartScale);
+        case RESTART_LINEAR:
+            return Search::Cutoff::linear(settings.restartScale);
+        default:
+            return Search::Cutoff::constant(settings.restartScale);
+    }
+}
+
+Search::Options search_options(size_t nthreads, SearchStop &stop)
+{
+    Search::Options o;
+    o.cutoff = make_cutoff();
+    o.nogoods_limit = settings.nogoods;
+    o.threads = nthreads;
+    o.stop = &stop;
+    return o;
+}
+
+// Prints the solutions of one search until stopToken says otherwise, or
+// after maxSolutions of them (0 for no limit)
+void run_single(const DictionaryDFA &automata, size_t nthreads, bool fancyBorders, std::vector<int> indices = std::vector<int>(), std::vector<int> required = std::vector<int>(), size_t maxSolutions = 0, const Strategy &strategy = Strategy())
+{
+    auto start = std::chrono::steady_clock::now();
+
+    SizeOptions opt("Crosswords");
+    opt.solutions(0);
+
+    auto model = make_model(opt, automata, fancyBorders, indices, required, strategy);
+    SearchStop stop(stopToken);
+    RBS<Crosswords, DFS> e(model.get(), search_options(nthreads, stop));
+
+    size_t found = 0;
+    while(!stopToken.Stopped())
+    {
+        Crosswords *p = e.next();
+        if(!p)
+            break;
+        ++found;
+
+        if(stopToken.AddSolution())
+        {
+            cout_mutex.lock();
+            if(strategy.id >= 0)
             {
-                if(size + 3 > height)
-                    return false;
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+                std::cout << "Found by portfolio member " << strategy.id
+                          << " (seed " << strategy.seed << ", order " << WORD_ORDER_NAMES[strategy.order]
+                          << ") in " << elapsed.count() << " ms" << std::endl;
             }
+            p->print(std::cout);
+            cout_mutex.unlock();
         }
+        delete p;
+
+        if(maxSolutions && found >= maxSolutions)
+            break;
     }
-    
-    return true;
+
+    std::string label = strategy.id >= 0 ? "portfolio " + std::to_string(strategy.id) : indices.empty() ? "single" : "placement";
+    statistics.AddSearch(label, e.statistics(), std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), found);
 }
 
-void run_single(size_t nthreads, bool fancyBorders, std::vector<int> indices = std::vector<int>())
+// Races size single-threaded searches, each with its own seed and word
+// order, until stopToken trips: with the default of one grid, the first
+// member to find one wins and the others are stopped.
+void run_portfolio(const DictionaryDFA &automata, size_t size, bool fancyBorders, const std::vector<int> &required = std::vector<int>())
 {
+    std::vector<std::thread> members;
+    unsigned int seed = Strategy().seed;
+    for(size_t i = 0; i < size; ++i)
+    {
+        Strategy strategy;
+        strategy.seed = seed + i / ORDER_COUNT;
+        strategy.order = (WordOrder) (i % ORDER_COUNT);
+        strategy.id = i;
+        members.emplace_back(run_single, std::cref(automata), 1, fancyBorders, std::vector<int>(), required, 0, strategy);
+    }
+
+    for(auto &member : members)
+        member.join();
+}
+
+// Keeps improving on the best grid so far (--optimize) until the time
+// budget is spent, on every core: large neighbourhood search around the
+// best grid, with branch and bound within each neighbourhood. Each better
+// grid is printed as soon as it is found, after its objective.
+void run_optimize(const DictionaryDFA &automata, const std::vector<int> &required)
+{
+    auto start = std::chrono::steady_clock::now();
 
     SizeOptions opt("Crosswords");
     opt.solutions(0);
 
-    Crosswords model(opt, WIDTH, HEIGHT, fancyBorders, indices);
-    Search::Options o;
-    Search::Cutoff *c = Search::Cutoff::constant(70000);
-    o.cutoff = c;
-    o.threads = nthreads;
-    RBS<Crosswords, DFS> e(&model, o);
-    if(auto *p = e.next())
+    auto model = make_model(opt, automata, FANCY_BORDERS, std::vector<int>(), required, Strategy());
+    SearchStop stop(stopToken);
+    RBS<Crosswords, BAB> e(model.get(), search_options(std::max(1u, std::thread::hardware_concurrency()), stop));
+
+    size_t found = 0;
+    while(!stopToken.Stopped())
     {
-        cout_mutex.lock();
+        Crosswords *p = e.next();
+        if(!p)
+            break;
+        ++found;
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        if(settings.optimize == OPTIMIZE_QUALITY)
+            std::cout << "Quality " << p->Objective();
+        else
+            std::cout << -p->Objective() << " black tiles";
+        std::cout << " after " << elapsed.count() << " ms" << std::endl;
         p->print(std::cout);
-        cout_mutex.unlock();
+        delete p;
     }
+
+    // Only the first search, before any neighbourhood, can be exhaustive
+    if(found && !e.stopped())
+        std::cout << "The last grid is optimal" << std::endl;
+
+    statistics.AddSearch("optimize", e.statistics(), std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), found);
 }
 
-void run_single_mandatory(bool fancyBorders, const std::vector<int> &indices)
+static std::string json_array(const std::vector<std::string> &strings)
 {
-    if(!permutation_valid(WIDTH, HEIGHT, fancyBorders, indices))
-        return;
-    run_single(1, fancyBorders, indices);
+    std::string array = "[";
+    for(size_t i = 0; i < strings.size(); ++i)
+        array += (i ? "," : "") + JsonValue::Quote(strings[i]);
+    return array + "]";
 }
 
-void run_concurrently(bool fancyBorders, std::vector<int> indices, size_t nthreads, size_t id)
+// Generates count distinct grids, one single-threaded search per grid
+// with seeds following Strategy().seed, on every core. Grids sharing more
+// than --max-overlap percent of their words with an earlier one are
+// dropped. Each grid is written as soon as it is found, as one JSON line:
+//   {"seed":1234,"grid":["row",...],"words":["word",...]}
+void run_batch(const DictionaryDFA &automata, size_t count, bool fancyBorders, const std::vector<int> &required = std::vector<int>())
 {
-    size_t i = 0;
-    do
-    {
-        if((i%nthreads) != id)
+    const unsigned int firstSeed = Strategy().seed;
+    std::atomic<unsigned int> nextSeed(firstSeed);
+
+    GridRegistry registry(settings.maxOverlap);
+    std::atomic<bool> unsatisfiable(false);
+    // Registered grids past the count (or the limits) are not written
+    std::atomic<size_t> written(0);
+    auto start = std::chrono::steady_clock::now();
+
+    auto worker = [&]() {
+        while(!stopToken.Stopped())
         {
-            ++i;
-            continue;
+            Strategy strategy;
+            strategy.seed = nextSeed++;
+
+            SizeOptions opt("Crosswords");
+            opt.solutions(0);
+            auto model = make_model(opt, automata, fancyBorders, std::vector<int>(), required, strategy);
+
+            auto searchStart = std::chrono::steady_clock::now();
+            SearchStop stop(stopToken);
+            RBS<Crosswords, DFS> e(model.get(), search_options(1, stop));
+            Crosswords *p = e.next();
+            statistics.AddSearch("batch", e.statistics(), std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - searchStart).count(), p != nullptr);
+            // An exhausted search means no seed can find a grid either
+            if(!p && !e.stopped())
+            {
+                unsatisfiable = true;
+                stopToken.Stop();
+                return;
+            }
+            if(!p)
+                continue;
+
+            std::vector<std::string> grid, words;
+            std::vector<int> fingerprint;
+            p->rows(grid);
+            p->wordlist(words);
+            p->indices(fingerprint);
+            delete p;
+
+            // Different seeds may still meet on (nearly) the same grid
+            if(!registry.TryAdd(fingerprint))
+                continue;
+
+            if(stopToken.AddSolution())
+            {
+                std::lock_guard<std::mutex> lock(cout_mutex);
+                std::cout << "{\"seed\":" << strategy.seed
+                          << ",\"grid\":" << json_array(grid)
+                          << ",\"words\":" << json_array(words) << "}" << std::endl;
+                ++written;
+            }
+        }
+    };
+
+    stopToken.Configure(count, settings.timeLimit, settings.nodeLimit);
+
+    std::vector<std::thread> workers;
+    size_t nthreads = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+    for(size_t i = 0; i < nthreads; ++i)
+        workers.emplace_back(worker);
+    for(auto &w : workers)
+        w.join();
+
+    if(unsatisfiable)
+        std::cerr << "No grid satisfies these constraints" << std::endl;
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << written << " distinct grids in " << elapsed << " s ("
+              << written / std::max(elapsed, 1e-9) << " grids/s), "
+              << registry.RejectedCount() << " rejected as too similar" << std::endl;
+}
+
+// Most mandatory words run_mandatory can place, one bit of Placement::used
+// each
+const size_t MAX_PLACED_WORDS = 64;
+
+// A prefix of a placement of the mandatory words: slots before `slot` are
+// decided, `used` flags the mandatory words already placed
+struct Placement
+{
+    std::vector<int> indices;
+    size_t slot;
+    uint64_t used;
+};
+
+// Explores the placements of the mandatory words over the slots, slot by
+// slot, on a work-stealing pool. Each decided slot is checked right away,
+// so that a failing prefix discards all the placements that extend it.
+// Every complete placement gets its own single-threaded search.
+void run_mandatory(const DictionaryDFA &automata, bool fancyBorders, const std::vector<int> &mandatory, size_t wordCount)
+{
+    size_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+    WorkStealingPool<Placement> pool(nthreads);
+    pool.Push(0, Placement{std::vector<int>(wordCount, 0), 0, 0});
+
+    pool.Run([&](Placement &placement, size_t worker) {
+        // Drain the remaining tasks once stopped
+        if(stopToken.Stopped())
+            return;
+
+        size_t placed = 0;
+        for(size_t m = 0; m < mandatory.size(); ++m)
+            placed += (placement.used >> m) & 1;
+
+        statistics.AddWorkerTask(worker, placed == mandatory.size());
+        if(placed == mandatory.size())
+        {
+            run_single(automata, 1, fancyBorders, placement.indices, std::vector<int>(), 1);
+            return;
+        }
+
+        size_t remainingSlots = wordCount - placement.slot;
+        size_t remainingWords = mandatory.size() - placed;
+        size_t slot = placement.slot;
+
+        // Pushed in reverse, so that the worker pops them in order
+        for(size_t m = mandatory.size(); m-- > 0;)
+        {
+            if((placement.used >> m) & 1)
+                continue;
+
+            Placement child{placement.indices, slot+1, placement.used | ((uint64_t) 1 << m)};
+            child.indices[slot] = mandatory[m];
+            if(slot_valid(automata.Width(), automata.Height(), fancyBorders, child.indices, slot))
+                pool.Push(worker, std::move(child));
         }
 
-        run_single_mandatory(fancyBorders, indices);
-        ++i;
-    } while(std::prev_permutation(indices.begin(), indices.end()));
+        // Leave the slot free, if the remaining words still fit
+        if(remainingSlots > remainingWords)
+            pool.Push(worker, Placement{placement.indices, slot+1, placement.used});
+    });
 }
 
 size_t permutation_count(size_t n, size_t k)
@@ -350,56 +1019,403 @@ size_t permutation_count(size_t n, size_t k)
     return result;
 }
 
-int main(void)
+// Second words of the pair model start 3 cells in and are at least 2
+// letters long
+size_t min_dimension()
 {
-    const bool FANCY_BORDERS = false;
+    return settings.model == MODEL_PAIRS ? 5 : 2;
+}
 
-    std::vector<int> mandatoryIndices;
-    dictionary.AddMandatoryWords("mandatory", HEIGHT, mandatoryIndices);
+// Word channels keep the starts and word lengths of a line in 64 bits
+size_t max_dimension()
+{
+    return std::min<size_t>(dictionary->MaxLength(), WordChannel::MAX_CELLS);
+}
+
+bool valid_dimension(double size)
+{
+    return size >= min_dimension() && size <= max_dimension();
+}
+
+// Starts building the automata make_model will need for that size
+void prefetch_model(const DictionaryDFA &automata)
+{
+    if(!pattern.Empty() && pattern.Width() == automata.Width() && pattern.Height() == automata.Height())
+    {
+        // The table propagation needs no automata
+        if(settings.propagation == PROPAGATION_TABLE)
+            return;
+        for(const auto &slot : pattern.Slots())
+            automata.Prefetch({{GRAPH_BORDER, slot.length}});
+    }
+    else if(settings.model == MODEL_SLOTS)
+        automata.PrefetchLines();
+    else
+        automata.PrefetchModel();
+}
+
+// Fills the pattern with the native engine, one search per thread with its
+// own seed. Searches restart with a new seed after a node cutoff, from
+// --restart-scale and growing geometrically; a thread that finds a grid
+// starts over until enough grids are found. --node-limit bounds the nodes
+// a thread spends on one grid. Returns false if the pattern has no fill.
+bool run_native(size_t nthreads)
+{
+    const unsigned int seed = settings.seed ? settings.seed : std::time(nullptr);
+    std::atomic<unsigned int> searches(0);
+    std::atomic<bool> exhausted(false);
+
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < nthreads; ++t)
+    {
+        threads.emplace_back([&]() {
+            FillEngine engine(*wordBitsets, pattern);
+            std::vector<std::string> lines;
+            unsigned long cutoff = settings.restartScale;
+            unsigned long spent = 0;
+            // Restarts included, like the Gecode searches
+            Search::Statistics total = Search::Statistics();
+            size_t found = 0;
+            auto start = std::chrono::steady_clock::now();
+            while(!stopToken.Stopped())
+            {
+                bool solved = engine.Solve(seed + searches++, stopToken, lines, cutoff);
+                spent += engine.Nodes();
+                total.node += engine.Nodes();
+                if(solved)
+                {
+                    ++found;
+                    if(stopToken.AddSolution())
+                    {
+                        std::lock_guard<std::mutex> lock(cout_mutex);
+                        print_grid(std::cout, lines);
+                    }
+                    cutoff = settings.restartScale;
+                    spent = 0;
+                }
+                else if(engine.Exhausted())
+                {
+                    // Every search covers the whole space, one is enough
+                    if(!exhausted.exchange(true))
+                        stopToken.Stop();
+                    break;
+                }
+                else if(stopToken.NodeLimit() && spent >= stopToken.NodeLimit())
+                    break;
+                else
+                {
+                    // A cutoff of 1 must grow too
+                    cutoff += std::max(1ul, cutoff / 2);
+                    ++total.restart;
+                }
+            }
+            statistics.AddSearch("native", total, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), found);
+        });
+    }
+    for(auto &thread : threads)
+        thread.join();
+
+    if(exhausted && !stopToken.Solutions())
+    {
+        std::cerr << "No fill exists for this pattern" << std::endl;
+        return false;
+    }
+    return true;
+}
 
-    DictionaryDFA dictDFA(dictionary, WIDTH, HEIGHT);
+// Drops the words that fit no slot of the pattern. Returns false if the
+// pattern cannot be filled.
+bool prune_dictionary(std::ostream &status)
+{
+    auto start = std::chrono::steady_clock::now();
+    PhaseTimer timer(&statistics, "prune");
+    const size_t before = dictionary->WordCount();
 
-    std::cout << "DFA conversion start..." << std::endl;
+    std::vector<char> keep;
+    DictionaryPruner pruner(*dictionary, dictionary->MaxLength());
+    if(!pruner.Fitting(pattern, keep))
+    {
+        std::cerr << "No word fits some slot of the pattern" << std::endl;
+        return false;
+    }
+    const size_t removed = dictionary->Retain(keep);
 
-    dfa_borderH = dictDFA.BorderH();
-    dfa_borderV = dictDFA.BorderV();
-    dfa_firstH = dictDFA.FirstH();
-    dfa_firstV = dictDFA.FirstV();
-    dfa_secondH = dictDFA.SecondH();
-    dfa_secondV = dictDFA.SecondV();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    status << "Pruned " << removed << " of " << before << " words ("
+           << (before ? 100 * removed / before : 0) << "%) in " << elapsed.count() << " ms" << std::endl;
+    return true;
+}
 
-    std::cout << "DFA conversion done!" << std::endl;
+// Writes the run statistics to --stats, if given ("-": standard error)
+bool write_statistics()
+{
+    if(settings.statsFile.empty())
+        return true;
+    if(settings.statsFile == "-")
+    {
+        std::cerr << statistics.Json() << std::endl;
+        return true;
+    }
 
-    if(mandatoryIndices.size())
+    std::ofstream file(settings.statsFile);
+    file << statistics.Json() << std::endl;
+    if(!file)
     {
-        const size_t wordCount = 2*(WIDTH+HEIGHT); // 2 words per col/row
-        if(mandatoryIndices.size() > wordCount)
+        std::cerr << "Could not write " << settings.statsFile << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Whether a JSON value is a whole number between min and max, checked on
+// the double before any conversion
+static bool json_integer(const JsonValue &value, double min, double max)
+{
+    return value.IsNumber() && value.Number() >= min && value.Number() <= max
+        && std::floor(value.Number()) == value.Number();
+}
+
+// Daemon request handler. Requests are JSON objects, all members optional:
+//   {"id":..., "width":9, "height":11, "mandatory":["word",...],
+//    "seed":1234, "time_limit":5000}
+// width and height default to --width and --height, mandatory words must
+// be in the dictionary (it is not rebuilt per request). The id is echoed back
+// in the reply, along with either the grid or why there is none:
+//   {"id":...,"status":"ok","seed":1234,"grid":[...],"words":[...]}
+//   {"id":...,"status":"timeout"|"unsatisfiable"|"error",...}
+// {"stats":true} asks for the run statistics instead:
+//   {"id":...,"status":"ok","stats":{...}}
+std::string solve_request(const JsonValue &request)
+{
+    std::string reply = "{";
+    if(request.Has("id"))
+        reply += "\"id\":" + request["id"].Dump() + ",";
+    auto error = [&](const std::string &message) {
+        return reply + "\"status\":\"error\",\"error\":" + JsonValue::Quote(message) + "}";
+    };
+
+    if(request["stats"].IsBool() && request["stats"].Bool())
+        return reply + "\"status\":\"ok\",\"stats\":" + statistics.Json() + "}";
+
+    size_t width = settings.width;
+    size_t height = settings.height;
+    for(auto dimension : {std::make_pair("width", &width), std::make_pair("height", &height)})
+    {
+        const JsonValue &value = request[dimension.first];
+        if(!request.Has(dimension.first))
+            continue;
+        if(!json_integer(value, min_dimension(), max_dimension()))
+            return error(std::string(dimension.first) + " must be an integer between " + std::to_string(min_dimension())
+                       + " and " + std::to_string(max_dimension()));
+        *dimension.second = value.Number();
+    }
+
+    std::vector<int> required;
+    for(const auto &word : request["mandatory"].Array())
+    {
+        int index = word.IsString() ? dictionary->IndexOfWord(word.String()) : -1;
+        if(index < 0)
+            return error("mandatory word not in the dictionary: " + word.Dump());
+        required.push_back(index);
+    }
+    std::sort(required.begin(), required.end(), std::greater<int>());
+    required.erase(std::unique(required.begin(), required.end()), required.end());
+
+    const double maxNumber = std::numeric_limits<unsigned int>::max();
+    for(const char *member : {"seed", "time_limit"})
+    {
+        if(request.Has(member) && !json_integer(request[member], 0, maxNumber))
+            return error(std::string(member) + " must be an integer between 0 and " + std::to_string((unsigned int) maxNumber));
+    }
+
+    Strategy strategy;
+    if(request.Has("seed"))
+        strategy.seed = request["seed"].Number();
+    // 0 keeps the --time-limit of the daemon
+    unsigned long timeLimit = settings.timeLimit;
+    if(request.Has("time_limit") && request["time_limit"].Number() > 0)
+        timeLimit = request["time_limit"].Number();
+
+    // Requests have their own budget, independent of the others
+    StopToken token;
+    token.Configure(1, timeLimit, settings.nodeLimit);
+
+    SizeOptions opt("Crosswords");
+    opt.solutions(0);
+    auto automata = automataCache->Get(width, height);
+    prefetch_model(*automata);
+    auto model = make_model(opt, *automata, FANCY_BORDERS, std::vector<int>(), required, strategy);
+
+    auto start = std::chrono::steady_clock::now();
+    SearchStop stop(token);
+    RBS<Crosswords, DFS> e(model.get(), search_options(1, stop));
+    Crosswords *p = e.next();
+    statistics.AddSearch("request", e.statistics(), std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), p != nullptr);
+    if(!p)
+        return reply + "\"status\":\"" + (e.stopped() ? "timeout" : "unsatisfiable") + "\"}";
+
+    std::vector<std::string> grid, words;
+    p->rows(grid);
+    p->wordlist(words);
+    delete p;
+
+    return reply + "\"status\":\"ok\",\"seed\":" + std::to_string(strategy.seed)
+         + ",\"grid\":" + json_array(grid) + ",\"words\":" + json_array(words) + "}";
+}
+
+int main(int argc, char **argv)
+{
+    if(!settings.Parse(argc, argv))
+        return EXIT_FAILURE;
+
+    if(!settings.compileInput.empty())
+    {
+        Dictionary source(settings.compileInput, settings.compileMaxlen);
+        if(!source.Save(settings.compileOutput))
         {
-            // TODO Error
+            std::cerr << "Could not write " << settings.compileOutput << std::endl;
+            return EXIT_FAILURE;
         }
+        std::cout << source.WordCount() << " words compiled into " << settings.compileOutput << std::endl;
+        return EXIT_SUCCESS;
+    }
 
-        std::cout << permutation_count(wordCount, mandatoryIndices.size()) << " permutations" << std::endl;
+    if(!settings.patternFile.empty())
+    {
+        std::string error;
+        if(!pattern.Load(settings.patternFile, error))
+        {
+            std::cerr << error << std::endl;
+            return EXIT_FAILURE;
+        }
+        settings.width = pattern.Width();
+        settings.height = pattern.Height();
+    }
 
-        std::vector<int> indices(wordCount, 0);
-        std::copy(mandatoryIndices.begin(), mandatoryIndices.end(), indices.begin());
-        std::sort(indices.begin(), indices.end(), std::greater<int>());
+    // Daemon requests may ask for any size up to --max-length
+    const bool daemon = settings.daemon || !settings.socketPath.empty();
+    size_t maxLength = std::max(settings.width, settings.height);
+    if(daemon)
+        maxLength = std::max(maxLength, settings.maxLength);
+    {
+        PhaseTimer timer(&statistics, "dictionary load");
+        dictionary.reset(new Dictionary(dictionary_path(), maxLength));
+    }
 
-        std::vector<std::thread> pool;
-        for(size_t i = 0; i < 4; ++i)
-            pool.emplace_back(run_concurrently, FANCY_BORDERS, indices, 4, i);
-        for(auto &thread : pool)
-            thread.join();
+    // Patterns have no second words, their only limit is the word length
+    if(pattern.Empty() && (!valid_dimension(settings.width) || !valid_dimension(settings.height)))
+    {
+        std::cerr << "Grid dimensions must be between " << min_dimension() << " and " << max_dimension() << std::endl;
+        return EXIT_FAILURE;
     }
-    else
-        run_single(4, FANCY_BORDERS);
+    // The word channels of pattern slots have the same limit
+    if(!pattern.Empty() && settings.encoding == INDEX_CHANNEL && std::max(settings.width, settings.height) > (size_t) WordChannel::MAX_CELLS)
+    {
+        std::cerr << "--encoding channel handles patterns of up to " << WordChannel::MAX_CELLS << " cells a side" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Keep stdout for the grids alone in batch and daemon modes
+    std::ostream &status = settings.batch || daemon ? std::cerr : std::cout;
+
+    // Before the mandatory words, which are kept whatever the pattern
+    if(settings.prune && !prune_dictionary(status))
+        return EXIT_FAILURE;
+
+    std::vector<int> mandatoryIndices;
+    dictionary->AddMandatoryWords("mandatory", maxLength, mandatoryIndices);
+
+    if(settings.engine == ENGINE_NATIVE || settings.propagation == PROPAGATION_TABLE
+    || settings.encoding == INDEX_CHANNEL || settings.model == MODEL_SLOTS)
+        wordBitsets.reset(new WordBitsets(*dictionary, maxLength));
+    if(settings.optimize == OPTIMIZE_QUALITY)
+        wordValues.reset(new WordValues(*dictionary));
+
+    // The native engine needs no automata
+    if(settings.engine == ENGINE_NATIVE)
+    {
+        if(mandatoryIndices.size())
+            std::cerr << "Mandatory words are ignored by the native engine" << std::endl;
+        stopToken.Configure(settings.solutions, settings.timeLimit, settings.nodeLimit);
+        const bool filled = run_native(std::max(1u, std::thread::hardware_concurrency()));
+        return write_statistics() && filled ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    status << "DFA initialization..." << std::endl;
+    auto start = std::chrono::steady_clock::now();
+
+    // Border automata are only used by patterns, one per slot length:
+    // fancy borders are expressed with rel constraints
+    automataCache.reset(new AutomataCache(*dictionary, settings.automataCacheSize, settings.encoding, settings.cacheDirectory, &statistics));
+    auto automata = automataCache->Get(settings.width, settings.height);
+    prefetch_model(*automata);
+    automata->Wait();
+
+    size_t states, transitions;
+    automata->Size(states, transitions);
+    statistics.SetAutomata(states, transitions);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    status << "DFA initialized! (" << states << " states, " << transitions << " transitions, "
+           << elapsed.count() << " ms)" << std::endl;
+
+    // The time budget covers the search only
+    stopToken.Configure(settings.solutions, settings.timeLimit, settings.nodeLimit);
 
-    delete dfa_borderH;
-    delete dfa_borderV;
-    delete dfa_firstH;
-    delete dfa_firstV;
-    delete dfa_secondH;
-    delete dfa_secondV;
+    std::sort(mandatoryIndices.begin(), mandatoryIndices.end(), std::greater<int>());
+    mandatoryIndices.erase(std::unique(mandatoryIndices.begin(), mandatoryIndices.end()), mandatoryIndices.end());
+
+    if(daemon)
+    {
+        Daemon server(std::max(1u, std::thread::hardware_concurrency()), solve_request);
+        status << "Serving requests" << std::endl;
+        if(settings.socketPath.empty())
+            server.ServeStream(STDIN_FILENO, STDOUT_FILENO);
+        else if(!server.ServeSocket(settings.socketPath))
+        {
+            std::cerr << "Could not listen on " << settings.socketPath << ": " << std::strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    else if(settings.optimize != OPTIMIZE_NONE)
+        run_optimize(*automata, mandatoryIndices);
+    else if(mandatoryIndices.size())
+    {
+        // Batches, portfolios, patterns and slots place the mandatory words
+        // within each search
+        const bool single = settings.mandatoryMode == MANDATORY_SINGLE || !pattern.Empty() || settings.model == MODEL_SLOTS
+                         || settings.portfolio;
+        const size_t wordCount = 2*(settings.width+settings.height); // 2 words per col/row
+        if(pattern.Empty() && settings.model == MODEL_PAIRS && mandatoryIndices.size() > wordCount)
+        {
+            std::cerr << mandatoryIndices.size() << " mandatory words do not fit in a " << settings.width << "x"
+                      << settings.height << " grid, which holds at most " << wordCount << " words" << std::endl;
+            return EXIT_FAILURE;
+        }
+        if(!single && !settings.batch && mandatoryIndices.size() > MAX_PLACED_WORDS)
+        {
+            std::cerr << "Placing more than " << MAX_PLACED_WORDS << " mandatory words needs --mandatory-mode single" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if(settings.batch)
+            run_batch(*automata, settings.batch, FANCY_BORDERS, mandatoryIndices);
+        else if(settings.portfolio)
+            run_portfolio(*automata, settings.portfolio, FANCY_BORDERS, mandatoryIndices);
+        else if(single)
+            run_single(*automata, std::max(1u, std::thread::hardware_concurrency()), FANCY_BORDERS, std::vector<int>(), mandatoryIndices);
+        else
+        {
+            std::cout << permutation_count(wordCount, mandatoryIndices.size()) << " permutations" << std::endl;
+            run_mandatory(*automata, FANCY_BORDERS, mandatoryIndices, wordCount);
+        }
+    }
+    else if(settings.batch)
+        run_batch(*automata, settings.batch, FANCY_BORDERS);
+    else if(settings.portfolio)
+        run_portfolio(*automata, settings.portfolio, FANCY_BORDERS);
+    else
+        run_single(*automata, 4, FANCY_BORDERS);
 
-    return EXIT_SUCCESS;
+    return write_statistics() ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
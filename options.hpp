@@ -0,0 +1,445 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
+
+#include "dfa.hpp"
+
+// How mandatory words are placed:
+//  - MANDATORY_PERMUTATIONS: one search per placement of the words over
+//    the slots
+//  - MANDATORY_SINGLE: a single search, in which the model itself chooses
+//    the slot of each word
+enum MandatoryMode
+{
+    MANDATORY_PERMUTATIONS,
+    MANDATORY_SINGLE
+};
+
+// Layout of the words of a line:
+//  - MODEL_PAIRS: at most two words per row and column
+//  - MODEL_SLOTS: any number of words, for larger grids
+enum ModelKind
+{
+    MODEL_PAIRS,
+    MODEL_SLOTS
+};
+
+// How the letters of a pattern slot are tied to its word:
+//  - PROPAGATION_AUTOMATA: extensional constraint on an exact-length automaton
+//  - PROPAGATION_TABLE: compact-table propagator over word bitsets
+enum PropagationKind
+{
+    PROPAGATION_AUTOMATA,
+    PROPAGATION_TABLE
+};
+
+// What fills the grid:
+//  - ENGINE_GECODE: the constraint model, the only one choosing black tiles
+//  - ENGINE_NATIVE: bitset backtracking over the slots of a fixed pattern
+enum EngineKind
+{
+    ENGINE_GECODE,
+    ENGINE_NATIVE
+};
+
+// What --optimize improves on, once a first grid is found:
+//  - OPTIMIZE_NONE: nothing, every grid is accepted
+//  - OPTIMIZE_QUALITY: the scores of the words, weighted by their length
+//  - OPTIMIZE_BLACKS: the number of black tiles, downwards
+enum OptimizeGoal
+{
+    OPTIMIZE_NONE,
+    OPTIMIZE_QUALITY,
+    OPTIMIZE_BLACKS
+};
+
+// Node cutoff sequence between restarts, scaled by Settings::restartScale
+enum RestartPolicy
+{
+    RESTART_CONSTANT,
+    RESTART_LUBY,
+    RESTART_GEOMETRIC,
+    RESTART_LINEAR
+};
+
+// Command line settings of the generator
+struct Settings
+{
+    Settings():
+        encoding(INDEX_SYMBOL),
+        cacheDirectory("dfa-cache"),
+        mandatoryMode(MANDATORY_PERMUTATIONS),
+        solutions(1),
+        timeLimit(0),
+        nodeLimit(0),
+        portfolio(0),
+        restart(RESTART_CONSTANT),
+        restartScale(70000),
+        nogoods(0),
+        seed(0),
+        batch(0),
+        maxOverlap(100),
+        daemon(false),
+        width(9),
+        height(11),
+        maxLength(32),
+        automataCacheSize(4),
+        model(MODEL_PAIRS),
+        maxBlacks(10),
+        engine(ENGINE_GECODE),
+        propagation(PROPAGATION_AUTOMATA),
+        prune(false),
+        optimize(OPTIMIZE_NONE),
+        relax(30),
+        compileMaxlen(32)
+    {
+    }
+
+    // Returns false (after printing why) on invalid arguments
+    bool Parse(int argc, char **argv)
+    {
+        for(int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            auto value = [&]() -> const char* {
+                return i+1 < argc ? argv[++i] : nullptr;
+            };
+
+            if(arg == "--compile-dict")
+            {
+                const char *input = value();
+                const char *output = value();
+                if(!input || !output)
+                    return usage("--compile-dict expects <text dictionary> <binary dictionary> [maxlen]");
+                compileInput = input;
+                compileOutput = output;
+                if(i+1 < argc && argv[i+1][0] != '-')
+                {
+                    unsigned long number;
+                    if(!parseNumber(value(), MAX_SIZE, number) || number < 2)
+                        return usage("--compile-dict expects a maxlen between 2 and " + std::to_string(MAX_SIZE));
+                    compileMaxlen = number;
+                }
+            }
+            else if(arg == "--encoding")
+            {
+                const char *v = value();
+                if(v && std::strcmp(v, "symbol") == 0)
+                    encoding = INDEX_SYMBOL;
+                else if(v && std::strcmp(v, "channel") == 0)
+                    encoding = INDEX_CHANNEL;
+                else
+                    return usage("--encoding expects symbol or channel");
+            }
+            else if(arg == "--dfa-cache")
+            {
+                const char *v = value();
+                if(!v)
+                    return usage("--dfa-cache expects a directory");
+                cacheDirectory = v;
+            }
+            else if(arg == "--no-dfa-cache")
+                cacheDirectory.clear();
+            else if(arg == "--mandatory-mode")
+            {
+                const char *v = value();
+                if(v && std::strcmp(v, "permutations") == 0)
+                    mandatoryMode = MANDATORY_PERMUTATIONS;
+                else if(v && std::strcmp(v, "single") == 0)
+                    mandatoryMode = MANDATORY_SINGLE;
+                else
+                    return usage("--mandatory-mode expects permutations or single");
+            }
+            else if(arg == "--daemon")
+                daemon = true;
+            else if(arg == "--prune")
+                prune = true;
+            else if(arg == "--model")
+            {
+                const char *v = value();
+                if(v && std::strcmp(v, "pairs") == 0)
+                    model = MODEL_PAIRS;
+                else if(v && std::strcmp(v, "slots") == 0)
+                    model = MODEL_SLOTS;
+                else
+                    return usage("--model expects pairs or slots");
+            }
+            else if(arg == "--engine")
+            {
+                const char *v = value();
+                if(v && std::strcmp(v, "gecode") == 0)
+                    engine = ENGINE_GECODE;
+                else if(v && std::strcmp(v, "native") == 0)
+                    engine = ENGINE_NATIVE;
+                else
+                    return usage("--engine expects gecode or native");
+            }
+            else if(arg == "--propagation")
+            {
+                const char *v = value();
+                if(v && std::strcmp(v, "automata") == 0)
+                    propagation = PROPAGATION_AUTOMATA;
+                else if(v && std::strcmp(v, "table") == 0)
+                    propagation = PROPAGATION_TABLE;
+                else
+                    return usage("--propagation expects automata or table");
+            }
+            else if(arg == "--optimize")
+            {
+                const char *v = value();
+                if(v && std::strcmp(v, "quality") == 0)
+                    optimize = OPTIMIZE_QUALITY;
+                else if(v && std::strcmp(v, "blacks") == 0)
+                    optimize = OPTIMIZE_BLACKS;
+                else
+                    return usage("--optimize expects quality or blacks");
+            }
+            else if(arg == "--stats")
+            {
+                const char *v = value();
+                if(!v)
+                    return usage("--stats expects a file");
+                statsFile = v;
+            }
+            else if(arg == "--pattern")
+            {
+                const char *v = value();
+                if(!v)
+                    return usage("--pattern expects a file");
+                patternFile = v;
+            }
+            else if(arg == "--socket")
+            {
+                const char *v = value();
+                if(!v)
+                    return usage("--socket expects a path");
+                socketPath = v;
+            }
+            else if(arg == "--restart")
+            {
+                const char *v = value();
+                if(v && std::strcmp(v, "constant") == 0)
+                    restart = RESTART_CONSTANT;
+                else if(v && std::strcmp(v, "luby") == 0)
+                    restart = RESTART_LUBY;
+                else if(v && std::strcmp(v, "geometric") == 0)
+                    restart = RESTART_GEOMETRIC;
+                else if(v && std::strcmp(v, "linear") == 0)
+                    restart = RESTART_LINEAR;
+                else
+                    return usage("--restart expects constant, luby, geometric or linear");
+            }
+            else if(arg == "--solutions" || arg == "--time-limit" || arg == "--node-limit" || arg == "--portfolio"
+                 || arg == "--restart-scale" || arg == "--nogoods" || arg == "--seed" || arg == "--batch"
+                 || arg == "--max-overlap" || arg == "--width" || arg == "--height" || arg == "--max-length"
+                 || arg == "--automata-cache-size" || arg == "--relax" || arg == "--max-blacks")
+            {
+                // Each number must fit the setting it goes to
+                unsigned long max = ULONG_MAX;
+                if(arg == "--nogoods" || arg == "--seed")
+                    max = UINT_MAX;
+                else if(arg == "--width" || arg == "--height" || arg == "--max-length")
+                    max = MAX_SIZE;
+                const char *v = value();
+                unsigned long number;
+                if(!v || !parseNumber(v, max, number))
+                    return usage(arg + " expects a number" + (max < ULONG_MAX ? " up to " + std::to_string(max) : ""));
+                if(arg == "--solutions")
+                    solutions = number;
+                else if(arg == "--time-limit")
+                    timeLimit = number;
+                else if(arg == "--node-limit")
+                    nodeLimit = number;
+                else if(arg == "--portfolio")
+                    portfolio = number;
+                else if(arg == "--restart-scale")
+                    restartScale = std::max(1ul, number);
+                else if(arg == "--nogoods")
+                    nogoods = number;
+                else if(arg == "--seed")
+                    seed = number;
+                else if(arg == "--batch")
+                    batch = number;
+                else if(arg == "--max-overlap")
+                    maxOverlap = std::min(100ul, number);
+                else if(arg == "--width")
+                    width = number;
+                else if(arg == "--height")
+                    height = number;
+                else if(arg == "--max-length")
+                    maxLength = number;
+                else if(arg == "--relax")
+                    relax = std::max(1ul, std::min(100ul, number));
+                else if(arg == "--max-blacks")
+                    maxBlacks = std::min(100ul, number);
+                else
+                    automataCacheSize = std::max(1ul, number);
+            }
+            else
+                return usage("unknown argument " + arg);
+        }
+
+        // The native engine does not choose black tiles, and only prints
+        // plain grids
+        if(engine == ENGINE_NATIVE && patternFile.empty())
+            return usage("--engine native needs --pattern");
+        if(engine == ENGINE_NATIVE && (batch || daemon || !socketPath.empty()))
+            return usage("--engine native does not support batches or daemon mode");
+        // Only pattern slots have a fixed length
+        if(propagation == PROPAGATION_TABLE && patternFile.empty())
+            return usage("--propagation table needs --pattern");
+        // Free layouts (and daemon requests of any size) rule no word out
+        if(prune && (patternFile.empty() || daemon || !socketPath.empty()))
+            return usage("--prune needs --pattern, and does not support daemon mode");
+        // Optimization never ends on its own, and streams a single grid
+        if(optimize != OPTIMIZE_NONE && !timeLimit)
+            return usage("--optimize needs --time-limit");
+        if(optimize != OPTIMIZE_NONE && (batch || portfolio || daemon || !socketPath.empty() || engine == ENGINE_NATIVE))
+            return usage("--optimize does not support batches, portfolios, daemon mode or the native engine");
+        if(optimize == OPTIMIZE_BLACKS && !patternFile.empty())
+            return usage("--optimize blacks cannot change the black tiles of a pattern");
+
+        return true;
+    }
+
+    IndexEncoding encoding;
+
+    // Where finished automata are cached, empty to disable
+    std::string cacheDirectory;
+
+    MandatoryMode mandatoryMode;
+
+    // Search budget, 0 means unlimited
+    size_t solutions;
+    unsigned long timeLimit; // ms
+    unsigned long nodeLimit; // per search engine
+
+    // Number of differently seeded and branched searches raced against
+    // each other, 0 for a single parallel search
+    size_t portfolio;
+
+    RestartPolicy restart;
+    unsigned long restartScale;
+    // Depth limit of the no-goods recorded at each restart, 0 to disable
+    unsigned int nogoods;
+    // Random seed of the search, 0 to seed from the clock
+    unsigned int seed;
+
+    // Number of grids to stream as JSON lines, 0 for the usual output
+    size_t batch;
+    // Largest share of words (percent) a batch grid may have in common
+    // with an earlier one
+    unsigned int maxOverlap;
+
+    // Serve JSON requests from stdin (daemon) or from a Unix socket
+    bool daemon;
+    std::string socketPath;
+
+    // Grid size, the default size of daemon requests
+    size_t width;
+    size_t height;
+    // Longest words loaded for daemon requests
+    size_t maxLength;
+    // Grid sizes whose automata are kept in memory
+    size_t automataCacheSize;
+
+    ModelKind model;
+    // Largest share of black tiles (percent) in grids of the slot model
+    unsigned int maxBlacks;
+    EngineKind engine;
+    PropagationKind propagation;
+    // Drop the words no grid can hold before building the automata
+    bool prune;
+
+    OptimizeGoal optimize;
+    // Share of the grid (percent) that each neighbourhood of the
+    // optimization frees around the best grid so far
+    unsigned int relax;
+
+    // Fixed black tiles, which also give the grid size
+    std::string patternFile;
+
+    // Where the JSON run statistics go at exit, "-" for standard error
+    std::string statsFile;
+
+    // Dictionary compilation mode, when compileInput is set
+    std::string compileInput;
+    std::string compileOutput;
+    size_t compileMaxlen;
+
+private:
+    static bool isNumber(const char *s)
+    {
+        return *s && std::strspn(s, "0123456789") == std::strlen(s);
+    }
+
+    // Grid sides and word lengths: far beyond any crossword, small enough
+    // for the per-length tables of the dictionary and the int domains
+    static const unsigned long MAX_SIZE = 4096;
+
+    // False unless s is a decimal number no larger than max
+    static bool parseNumber(const char *s, unsigned long max, unsigned long &number)
+    {
+        if(!isNumber(s))
+            return false;
+        errno = 0;
+        number = std::strtoul(s, nullptr, 10);
+        return errno != ERANGE && number <= max;
+    }
+
+    static bool usage(const std::string &error)
+    {
+        std::cerr << "crosswords: " << error << std::endl
+                  << "Usage: crosswords [options]" << std::endl
+                  << "  --compile-dict <in> <out> [maxlen]  compile a text dictionary to binary and exit" << std::endl
+                  << "  --encoding symbol|channel           how word indices are tied to the automata" << std::endl
+                  << "  --dfa-cache <dir>                   automata cache directory (default dfa-cache)" << std::endl
+                  << "  --no-dfa-cache                      always rebuild the automata" << std::endl
+                  << "  --mandatory-mode permutations|single" << std::endl
+                  << "                                      one search per placement of the mandatory words," << std::endl
+                  << "                                      or a single search placing them" << std::endl
+                  << "  --solutions <n>                     stop after n grids (default 1, 0: no limit)" << std::endl
+                  << "  --time-limit <ms>                   stop searching after that long" << std::endl
+                  << "  --node-limit <n>                    give up on a search after n nodes" << std::endl
+                  << "  --portfolio <n>                     race n searches with different seeds and word orders" << std::endl
+                  << "  --restart constant|luby|geometric|linear" << std::endl
+                  << "                                      node cutoff sequence between restarts (default constant)" << std::endl
+                  << "  --restart-scale <n>                 cutoff scale in nodes (default 70000)" << std::endl
+                  << "  --nogoods <depth>                   keep the no-goods of each restart, up to that depth" << std::endl
+                  << "  --seed <n>                          fixed random seed (default: clock)" << std::endl
+                  << "  --batch <n>                         stream n distinct grids as JSON lines" << std::endl
+                  << "  --max-overlap <percent>             drop batch grids sharing more words with an earlier one" << std::endl
+                  << "  --daemon                            serve JSON requests read from stdin" << std::endl
+                  << "  --socket <path>                     serve JSON requests on a Unix socket" << std::endl
+                  << "  --width <n>, --height <n>           grid size (default 9x11)" << std::endl
+                  << "  --model pairs|slots                 up to two words per line, or any number of them" << std::endl
+                  << "  --max-blacks <percent>              largest share of black tiles of --model slots" << std::endl
+                  << "                                      (default 10)" << std::endl
+                  << "  --pattern <file>                    fixed black tiles, one line per row, '#' for black" << std::endl
+                  << "  --engine gecode|native              fill with the constraint model, or with bitset" << std::endl
+                  << "                                      backtracking (needs --pattern)" << std::endl
+                  << "  --propagation automata|table        pattern slots use automata, or a compact table of" << std::endl
+                  << "                                      the words (needs --pattern)" << std::endl
+                  << "  --prune                             drop the words no slot of the pattern can hold" << std::endl
+                  << "                                      before building the automata (needs --pattern)" << std::endl
+                  << "  --optimize quality|blacks           keep improving the grid until --time-limit, on the" << std::endl
+                  << "                                      word scores or the number of black tiles" << std::endl
+                  << "  --relax <percent>                   share of the grid each optimization step frees" << std::endl
+                  << "                                      (default 30)" << std::endl
+                  << "  --stats <file>                      write phase timings and search statistics as JSON" << std::endl
+                  << "                                      at exit (-: standard error)" << std::endl
+                  << "  --max-length <n>                    largest dimension of daemon requests (default 32)" << std::endl
+                  << "  --automata-cache-size <n>           grid sizes whose automata stay in memory (default 4)" << std::endl;
+        return false;
+    }
+};
+
+#endif
+
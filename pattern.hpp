@@ -0,0 +1,137 @@
+#ifndef PATTERN_HPP
+#define PATTERN_HPP
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Fixed layout of the black tiles of a grid, read from a text file with one
+// line per row: '#' is a black tile, any other character a letter.
+//
+// Slots are the maximal runs of at least 2 letters, in rows and columns.
+// Their length is known up front, so each gets an exact-length automaton.
+class Pattern
+{
+    public:
+        // Cells start, start+step, ..., start+(length-1)*step
+        struct Slot
+        {
+            size_t start;
+            size_t step;
+            size_t length;
+        };
+
+        Pattern():
+            width(0),
+            height(0)
+        {
+        }
+
+        // Returns false (with error set) on a missing or ragged file
+        bool Load(const std::string &filename, std::string &error)
+        {
+            std::ifstream file(filename);
+            if(!file)
+            {
+                error = "cannot read " + filename;
+                return false;
+            }
+
+            std::vector<std::string> lines;
+            std::string line;
+            while(std::getline(file, line))
+            {
+                if(!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                if(!line.empty())
+                    lines.push_back(line);
+            }
+
+            if(lines.empty() || lines[0].size() < 2 || lines.size() < 2)
+            {
+                error = filename + ": a pattern needs at least 2 rows and 2 columns";
+                return false;
+            }
+            for(const auto &row : lines)
+            {
+                if(row.size() != lines[0].size())
+                {
+                    error = filename + ": rows must all have the same length";
+                    return false;
+                }
+            }
+
+            width = lines[0].size();
+            height = lines.size();
+            black.assign(width * height, false);
+            for(size_t y = 0; y < height; ++y)
+            {
+                for(size_t x = 0; x < width; ++x)
+                    black[x+y*width] = lines[y][x] == '#';
+            }
+
+            slots.clear();
+            for(size_t y = 0; y < height; ++y)
+                addRuns(y*width, 1, width);
+            for(size_t x = 0; x < width; ++x)
+                addRuns(x, width, height);
+
+            // Empty() would then take it for no pattern at all
+            if(slots.empty())
+            {
+                error = filename + ": pattern has no word slots";
+                return false;
+            }
+            return true;
+        }
+
+        bool Empty() const
+        {
+            return slots.empty();
+        }
+
+        size_t Width() const
+        {
+            return width;
+        }
+
+        size_t Height() const
+        {
+            return height;
+        }
+
+        bool IsBlack(size_t cell) const
+        {
+            return black[cell];
+        }
+
+        const std::vector<Slot> &Slots() const
+        {
+            return slots;
+        }
+
+    protected:
+        // Slots of the line of size cells starting at first
+        void addRuns(size_t first, size_t step, size_t size)
+        {
+            size_t run = 0;
+            for(size_t k = 0; k <= size; ++k)
+            {
+                if(k < size && !black[first + k*step])
+                {
+                    ++run;
+                    continue;
+                }
+                if(run >= 2)
+                    slots.push_back(Slot{first + (k-run)*step, step, run});
+                run = 0;
+            }
+        }
+
+        size_t width;
+        size_t height;
+        std::vector<bool> black;
+        std::vector<Slot> slots;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef PRUNE_HPP
+#define PRUNE_HPP
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "dictionary.hpp"
+#include "fill.hpp"
+#include "pattern.hpp"
+
+// Finds the words of a dictionary that no fill of a pattern can hold, so
+// that they can be dropped before the automata are built.
+//
+// Only patterns are pruned: in a free layout a cell may hold a letter that
+// no word crosses, so crossings prove nothing. In a pattern every letter
+// belongs to known slots, and the letters each cell may hold are narrowed
+// until they no longer change:
+// a slot keeps the words whose letters are all allowed at their cells,
+// and a cell keeps the letters that the words of every slot through it
+// allow. Distinctness is ignored, so no word that could fit is dropped.
+class DictionaryPruner
+{
+    public:
+        DictionaryPruner(const Dictionary &dict, size_t maxlen):
+            dictionary(dict),
+            bits(dict, maxlen),
+            maxlen(std::min(maxlen, dict.MaxLength()))
+        {
+        }
+
+        // Flags the words that fit some slot of the pattern, returns false
+        // if some slot has no word left (the pattern cannot be filled)
+        bool Fitting(const Pattern &pattern, std::vector<char> &keep) const
+        {
+            const auto &slots = pattern.Slots();
+            std::vector<uint32_t> cellLetters(pattern.Width() * pattern.Height(), ALL_LETTERS);
+            std::vector<std::vector<size_t> > cellSlots(cellLetters.size());
+            for(size_t s = 0; s < slots.size(); ++s)
+            {
+                for(size_t k = 0; k < slots[s].length; ++k)
+                    cellSlots[cell(slots[s], k)].push_back(s);
+            }
+
+            std::vector<std::vector<uint64_t> > words(slots.size());
+            for(size_t s = 0; s < slots.size(); ++s)
+            {
+                const uint64_t *valid = bits.Valid(slots[s].length);
+                words[s].assign(valid, valid + bits.Blocks(slots[s].length));
+            }
+
+            std::deque<size_t> queue;
+            std::vector<char> queued(slots.size(), 1);
+            for(size_t s = 0; s < slots.size(); ++s)
+                queue.push_back(s);
+
+            while(!queue.empty())
+            {
+                const size_t s = queue.front();
+                queue.pop_front();
+                queued[s] = 0;
+
+                const Pattern::Slot &slot = slots[s];
+                const size_t blocks = words[s].size();
+
+                // Words with a letter no longer allowed
+                for(size_t k = 0; k < slot.length; ++k)
+                {
+                    const uint32_t letters = cellLetters[cell(slot, k)];
+                    if(letters == ALL_LETTERS)
+                        continue;
+                    std::vector<uint64_t> mask(blocks, 0);
+                    for(int c = 0; c < LETTERS; ++c)
+                    {
+                        if(!(letters & (1u << c)))
+                            continue;
+                        const uint64_t *support = bits.Letter(slot.length, k, 'a' + c);
+                        for(size_t b = 0; b < blocks; ++b)
+                            mask[b] |= support[b];
+                    }
+                    for(size_t b = 0; b < blocks; ++b)
+                        words[s][b] &= mask[b];
+                }
+
+                // Letters no longer used by a word
+                bool empty = true;
+                for(size_t k = 0; k < slot.length; ++k)
+                {
+                    uint32_t letters = 0;
+                    for(int c = 0; c < LETTERS; ++c)
+                    {
+                        const uint64_t *support = bits.Letter(slot.length, k, 'a' + c);
+                        for(size_t b = 0; b < blocks; ++b)
+                        {
+                            if(words[s][b] & support[b])
+                            {
+                                letters |= 1u << c;
+                                break;
+                            }
+                        }
+                    }
+                    empty = empty && !letters;
+
+                    const size_t c = cell(slot, k);
+                    if((cellLetters[c] & letters) == cellLetters[c])
+                        continue;
+                    cellLetters[c] &= letters;
+                    for(size_t other : cellSlots[c])
+                    {
+                        if(other != s && !queued[other])
+                        {
+                            queued[other] = 1;
+                            queue.push_back(other);
+                        }
+                    }
+                }
+                if(empty)
+                    return false;
+            }
+
+            keep.assign(dictionary.WordCount(), 0);
+            for(size_t s = 0; s < slots.size(); ++s)
+                flag(slots[s].length, words[s], keep);
+            return true;
+        }
+
+    private:
+        static const int LETTERS = 26;
+        static const uint32_t ALL_LETTERS = (1u << LETTERS) - 1;
+
+        static size_t cell(const Pattern::Slot &slot, size_t k)
+        {
+            return slot.start + k*slot.step;
+        }
+
+        // Flags the words of a bitset over the words of that length
+        void flag(size_t length, const std::vector<uint64_t> &words, std::vector<char> &keep) const
+        {
+            const size_t first = dictionary.FirstIndexOfLength(length) - MIN_INDEX - 1;
+            for(size_t b = 0; b < words.size(); ++b)
+            {
+                for(uint64_t block = words[b]; block; block &= block - 1)
+                    keep[first + b*64 + __builtin_ctzll(block)] = 1;
+            }
+        }
+
+        const Dictionary &dictionary;
+        WordBitsets bits;
+        size_t maxlen;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs tasks on a fixed set of workers, each with its own deque. A worker
+// takes its newest task first (depth-first, which keeps the number of
+// pending tasks small) and, when it runs dry, steals the oldest task of
+// another worker (the largest chunks of remaining work).
+//
+// Tasks may push new tasks while they run; Run() returns once every task,
+// including those pushed along the way, is done.
+template<class Task>
+class WorkStealingPool
+{
+    public:
+        typedef std::function<void(Task &task, size_t worker)> Runner;
+
+        explicit WorkStealingPool(size_t workers):
+            queues(workers),
+            pending(0)
+        {
+        }
+
+        size_t WorkerCount() const
+        {
+            return queues.size();
+        }
+
+        // To be called from a running task (or before Run)
+        void Push(size_t worker, Task task)
+        {
+            ++pending;
+            {
+                std::lock_guard<std::mutex> lock(queues[worker].mutex);
+                queues[worker].tasks.push_back(std::move(task));
+            }
+            idle.notify_one();
+        }
+
+        void Run(const Runner &runner)
+        {
+            std::vector<std::thread> threads;
+            for(size_t worker = 0; worker < queues.size(); ++worker)
+                threads.emplace_back(&WorkStealingPool::work, this, std::cref(runner), worker);
+            for(auto &thread : threads)
+                thread.join();
+        }
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        bool popOwn(size_t worker, Task &task)
+        {
+            std::lock_guard<std::mutex> lock(queues[worker].mutex);
+            if(queues[worker].tasks.empty())
+                return false;
+            task = std::move(queues[worker].tasks.back());
+            queues[worker].tasks.pop_back();
+            return true;
+        }
+
+        bool steal(size_t worker, Task &task)
+        {
+            for(size_t i = 1; i < queues.size(); ++i)
+            {
+                Queue &victim = queues[(worker + i) % queues.size()];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if(!victim.tasks.empty())
+                {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void work(const Runner &runner, size_t worker)
+        {
+            Task task;
+            while(pending > 0)
+            {
+                if(popOwn(worker, task) || steal(worker, task))
+                {
+                    runner(task, worker);
+                    if(--pending == 0)
+                        idle.notify_all();
+                    continue;
+                }
+
+                // Everything left is running elsewhere and may still push
+                std::unique_lock<std::mutex> lock(idleMutex);
+                idle.wait_for(lock, std::chrono::milliseconds(1));
+            }
+        }
+
+        std::vector<Queue> queues;
+        std::atomic<size_t> pending;
+
+        std::mutex idleMutex;
+        std::condition_variable idle;
+};
+
+#endif
+
@@ -0,0 +1,248 @@
+#ifndef SCORE_HPP
+#define SCORE_HPP
+
+#include <vector>
+#include <algorithm>
+
+#include <gecode/int.hh>
+
+#include "dictionary.hpp"
+
+// What each word adds to the quality of a grid: its score times its
+// length, so that splitting a long word into short ones does not pay.
+// MIN_INDEX (no word) adds nothing.
+class WordValues
+{
+    public:
+        explicit WordValues(const Dictionary &dict):
+            dictionary(dict),
+            lowest(dict.MaxLength() + 1, 0),
+            highest(dict.MaxLength() + 1, 0)
+        {
+            for(size_t length = 2; length <= dict.MaxLength(); ++length)
+            {
+                const int first = dict.FirstIndexOfLength(length);
+                const int last = dict.LastIndexOfLength(length);
+                if(first > last)
+                    continue;
+                lowest[length] = MAX_WORD_SCORE * length;
+                for(int index = first; index <= last; ++index)
+                {
+                    lowest[length] = std::min(lowest[length], Value(index));
+                    highest[length] = std::max(highest[length], Value(index));
+                }
+            }
+        }
+
+        int Value(int index) const
+        {
+            if(index <= (int) MIN_INDEX)
+                return 0;
+            return dictionary.GetScore(index) * length(index);
+        }
+
+        // Bounds of the values of the indices from min to max. Words are
+        // sorted by length, so these are the bounds of the lengths spanned.
+        void Bounds(int min, int max, int &low, int &high) const
+        {
+            low = min <= (int) MIN_INDEX ? 0 : Value(min);
+            high = 0;
+            if(max <= (int) MIN_INDEX)
+                return;
+            for(size_t l = length(std::max(min, (int) MIN_INDEX + 1)); l <= length(max); ++l)
+            {
+                low = std::min(low, lowest[l]);
+                high = std::max(high, highest[l]);
+            }
+        }
+
+        // Writes the index ranges within min to max of the lengths, and of
+        // MIN_INDEX, whose values are all below needed, as Gecode range
+        // iterators want them: increasing and apart. ranges needs room for
+        // MaxRanges() of them; returns how many were written.
+        int Worthless(int min, int max, int needed, Gecode::Iter::Ranges::Array::Range *ranges) const
+        {
+            int n = 0;
+            auto add = [&](int first, int last) {
+                if(n > 0 && ranges[n-1].max + 1 == first)
+                    ranges[n-1].max = last;
+                else
+                    ranges[n++] = {first, last};
+            };
+
+            if(min <= (int) MIN_INDEX && needed > 0)
+                add(MIN_INDEX, MIN_INDEX);
+            if(max <= (int) MIN_INDEX)
+                return n;
+            for(size_t l = length(std::max(min, (int) MIN_INDEX + 1)); l <= length(max); ++l)
+            {
+                const int first = dictionary.FirstIndexOfLength(l);
+                const int last = dictionary.LastIndexOfLength(l);
+                if(first <= last && highest[l] < needed)
+                    add(first, last);
+            }
+            return n;
+        }
+
+        int MaxRanges() const
+        {
+            return highest.size();
+        }
+
+        // The largest a grid with that many word slots can score
+        int Limit(size_t slots) const
+        {
+            return *std::max_element(highest.begin(), highest.end()) * slots;
+        }
+
+    private:
+        size_t length(int index) const
+        {
+            return dictionary.GetWord(index).size();
+        }
+
+        const Dictionary &dictionary;
+        // Extreme values of the words of each length
+        std::vector<int> lowest;
+        std::vector<int> highest;
+};
+
+// quality == sum of the values of the words x, see WordValues.
+//
+// Filtering is on bounds: each unfixed word counts for the extreme values
+// of the lengths its index range spans, which bounds quality. Once quality
+// must exceed what the other words can reach, a word loses the lengths
+// none of whose words are worth enough to make up for it, and the words
+// at its bounds that are not, which is what drives branch and bound
+// towards better words.
+class WordScore: public Gecode::Propagator
+{
+    public:
+        WordScore(Gecode::Home home, Gecode::ViewArray<Gecode::Int::IntView> &x, Gecode::Int::IntView quality, const WordValues &values):
+            Gecode::Propagator(home),
+            x(x),
+            quality(quality),
+            values(&values)
+        {
+            x.subscribe(home, *this, Gecode::Int::PC_INT_BND);
+            quality.subscribe(home, *this, Gecode::Int::PC_INT_BND);
+        }
+
+        WordScore(Gecode::Space &home, WordScore &p):
+            Gecode::Propagator(home, p),
+            values(p.values)
+        {
+            x.update(home, p.x);
+            quality.update(home, p.quality);
+        }
+
+        static Gecode::ExecStatus post(Gecode::Home home, Gecode::ViewArray<Gecode::Int::IntView> &x, Gecode::Int::IntView quality, const WordValues &values)
+        {
+            (void) new (home) WordScore(home, x, quality, values);
+            return Gecode::ES_OK;
+        }
+
+        virtual Gecode::Propagator *copy(Gecode::Space &home)
+        {
+            return new (home) WordScore(home, *this);
+        }
+
+        virtual Gecode::PropCost cost(const Gecode::Space &, const Gecode::ModEventDelta &) const
+        {
+            return Gecode::PropCost::linear(Gecode::PropCost::HI, x.size());
+        }
+
+        virtual void reschedule(Gecode::Space &home)
+        {
+            x.reschedule(home, *this, Gecode::Int::PC_INT_BND);
+            quality.reschedule(home, *this, Gecode::Int::PC_INT_BND);
+        }
+
+        virtual Gecode::ExecStatus propagate(Gecode::Space &home, const Gecode::ModEventDelta &)
+        {
+            Gecode::Region r;
+            int *low = r.alloc<int>(x.size());
+            int *high = r.alloc<int>(x.size());
+            int lowSum = 0;
+            int highSum = 0;
+            bool assigned = true;
+            for(int i = 0; i < x.size(); ++i)
+            {
+                if(x[i].assigned())
+                    low[i] = high[i] = values->Value(x[i].val());
+                else
+                {
+                    values->Bounds(x[i].min(), x[i].max(), low[i], high[i]);
+                    assigned = false;
+                }
+                lowSum += low[i];
+                highSum += high[i];
+            }
+
+            GECODE_ME_CHECK(quality.gq(home, lowSum));
+            GECODE_ME_CHECK(quality.lq(home, highSum));
+            if(assigned)
+                return home.ES_SUBSUMED(*this);
+
+            // Words that cannot be worth enough: whole lengths first, then
+            // single words at the bounds, which never walks an index twice
+            // along a branch
+            Gecode::Iter::Ranges::Array::Range *ranges = r.alloc<Gecode::Iter::Ranges::Array::Range>(values->MaxRanges());
+            bool pruned = false;
+            for(int i = 0; i < x.size(); ++i)
+            {
+                const int needed = quality.min() - (highSum - high[i]);
+                if(x[i].assigned() || needed <= low[i])
+                    continue;
+
+                const int n = values->Worthless(x[i].min(), x[i].max(), needed, ranges);
+                if(n > 0)
+                {
+                    Gecode::Iter::Ranges::Array worthless(ranges, n);
+                    Gecode::ModEvent me = x[i].minus_r(home, worthless, false);
+                    GECODE_ME_CHECK(me);
+                    pruned = pruned || Gecode::me_modified(me);
+                }
+
+                int min = x[i].min();
+                while(min <= x[i].max() && values->Value(min) < needed)
+                    ++min;
+                Gecode::ModEvent me = x[i].gq(home, min);
+                GECODE_ME_CHECK(me);
+                pruned = pruned || Gecode::me_modified(me);
+
+                int max = x[i].max();
+                while(max >= x[i].min() && values->Value(max) < needed)
+                    --max;
+                me = x[i].lq(home, max);
+                GECODE_ME_CHECK(me);
+                pruned = pruned || Gecode::me_modified(me);
+            }
+
+            // Removed words may have moved the bounds of the others
+            return pruned ? Gecode::ES_NOFIX : Gecode::ES_FIX;
+        }
+
+        virtual size_t dispose(Gecode::Space &home)
+        {
+            x.cancel(home, *this, Gecode::Int::PC_INT_BND);
+            quality.cancel(home, *this, Gecode::Int::PC_INT_BND);
+            (void) Gecode::Propagator::dispose(home);
+            return sizeof(*this);
+        }
+
+    protected:
+        Gecode::ViewArray<Gecode::Int::IntView> x;
+        Gecode::Int::IntView quality;
+        const WordValues *values;
+};
+
+// Posts WordScore, see above
+inline void wordscore(Gecode::Home home, const Gecode::IntVarArgs &words, Gecode::IntVar quality, const WordValues &values)
+{
+    GECODE_POST;
+    Gecode::ViewArray<Gecode::Int::IntView> x(home, words);
+    GECODE_ES_FAIL(WordScore::post(home, x, quality, values));
+}
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <gecode/search.hh>
+
+// Where the time of a run goes, for --stats and the daemon's stats
+// requests: wall time and peak RSS at the end of each phase (dictionary
+// load, each graph build or load, each conversion to a Gecode DFA), the
+// Gecode statistics of each search, and the work done by each worker of
+// the mandatory word placements. Shared by all the threads of a run.
+class RunStatistics
+{
+    public:
+        RunStatistics():
+            totals{"", 0, 0, 0, 0, 0, 0, 0, 0},
+            searchCount(0),
+            automataStates(0),
+            automataTransitions(0)
+        {
+        }
+
+        // Peak resident set size of the process so far, in kB
+        static long PeakRss()
+        {
+            struct rusage usage;
+            if(getrusage(RUSAGE_SELF, &usage) < 0)
+                return 0;
+            return usage.ru_maxrss;
+        }
+
+        void AddPhase(const std::string &name, double ms)
+        {
+            long rss = PeakRss();
+            std::lock_guard<std::mutex> lock(mutex);
+            phases.push_back(Phase{name, ms, rss});
+        }
+
+        void AddSearch(const std::string &label, const Gecode::Search::Statistics &s, double ms, size_t solutions)
+        {
+            Search search{label, ms, solutions, s.node, s.fail, s.restart, s.nogood, s.propagate, s.depth};
+            std::lock_guard<std::mutex> lock(mutex);
+            ++searchCount;
+            totals.ms += ms;
+            totals.solutions += solutions;
+            totals.nodes += s.node;
+            totals.fails += s.fail;
+            totals.restarts += s.restart;
+            totals.nogoods += s.nogood;
+            totals.propagations += s.propagate;
+            totals.depth = std::max(totals.depth, (unsigned long) s.depth);
+
+            // Daemons run forever: only the latest searches are detailed
+            searches.push_back(search);
+            if(searches.size() > MAX_SEARCHES)
+                searches.pop_front();
+        }
+
+        // Size of the automata of the main grid size, once built
+        void SetAutomata(size_t states, size_t transitions)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            automataStates = states;
+            automataTransitions = transitions;
+        }
+
+        // One more task (and search, if it reached one) done by a worker
+        void AddWorkerTask(size_t worker, bool searched)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(workers.size() <= worker)
+                workers.resize(worker + 1);
+            ++workers[worker].placements;
+            workers[worker].searches += searched;
+        }
+
+        std::string Json() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::ostringstream os;
+            os << "{\"peak_rss_kb\":" << PeakRss()
+               << ",\"automata\":{\"states\":" << automataStates << ",\"transitions\":" << automataTransitions << "}"
+               << ",\"phases\":[";
+            for(size_t i = 0; i < phases.size(); ++i)
+            {
+                os << (i ? "," : "") << "{\"name\":\"" << phases[i].name << "\",\"ms\":" << phases[i].ms
+                   << ",\"peak_rss_kb\":" << phases[i].peakRss << "}";
+            }
+            os << "],\"searches\":[";
+            for(size_t i = 0; i < searches.size(); ++i)
+                os << (i ? "," : "") << searchJson(searches[i]);
+            os << "],\"search_totals\":" << searchJson(totals, searchCount) << ",\"workers\":[";
+            for(size_t i = 0; i < workers.size(); ++i)
+            {
+                os << (i ? "," : "") << "{\"worker\":" << i << ",\"placements\":" << workers[i].placements
+                   << ",\"searches\":" << workers[i].searches << "}";
+            }
+            os << "]}";
+            return os.str();
+        }
+
+    private:
+        static const size_t MAX_SEARCHES = 1000;
+
+        struct Phase
+        {
+            std::string name;
+            double ms;
+            long peakRss;
+        };
+
+        struct Search
+        {
+            std::string label;
+            double ms;
+            size_t solutions;
+            unsigned long nodes;
+            unsigned long fails;
+            unsigned long restarts;
+            unsigned long nogoods;
+            unsigned long propagations;
+            unsigned long depth;
+        };
+
+        struct Worker
+        {
+            Worker():
+                placements(0),
+                searches(0)
+            {
+            }
+
+            size_t placements;
+            size_t searches;
+        };
+
+        // With count, the totals of that many searches (and their deepest
+        // depth)
+        static std::string searchJson(const Search &s, size_t count = 0)
+        {
+            std::ostringstream os;
+            os << "{";
+            if(count)
+                os << "\"count\":" << count << ",";
+            else
+                os << "\"label\":\"" << s.label << "\",";
+            os << "\"ms\":" << s.ms << ",\"solutions\":" << s.solutions << ",\"nodes\":" << s.nodes
+               << ",\"fails\":" << s.fails << ",\"restarts\":" << s.restarts << ",\"nogoods\":" << s.nogoods
+               << ",\"propagations\":" << s.propagations << ",\"depth\":" << s.depth << "}";
+            return os.str();
+        }
+
+        mutable std::mutex mutex;
+        std::vector<Phase> phases;
+        std::deque<Search> searches;
+        Search totals;
+        size_t searchCount;
+        size_t automataStates;
+        size_t automataTransitions;
+        std::vector<Worker> workers;
+};
+
+// Records the wall time from construction to destruction as a phase of
+// stats, if any
+class PhaseTimer
+{
+    public:
+        PhaseTimer(RunStatistics *stats, std::string name):
+            stats(stats),
+            name(std::move(name)),
+            start(std::chrono::steady_clock::now())
+        {
+        }
+
+        PhaseTimer(const PhaseTimer &) = delete;
+        PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+        ~PhaseTimer()
+        {
+            Stop();
+        }
+
+        // Records the phase now rather than at destruction
+        void Stop()
+        {
+            if(stats)
+                stats->AddPhase(name, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            stats = nullptr;
+        }
+
+        // When what the phase turned out to be is only known along the way
+        void Rename(std::string newName)
+        {
+            name = std::move(newName);
+        }
+
+    private:
+        RunStatistics *stats;
+        std::string name;
+        std::chrono::steady_clock::time_point start;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef STOP_HPP
+#define STOP_HPP
+
+#include <atomic>
+#include <chrono>
+
+#include <gecode/search.hh>
+
+// Shared by all the searches of a run, so that they all give up as soon as
+// enough grids have been found or the time budget is spent
+class StopToken
+{
+    public:
+        StopToken():
+            stopped(false),
+            solutions(0),
+            maxSolutions(0),
+            hasDeadline(false),
+            nodeLimit(0)
+        {
+        }
+
+        // maxSolutions, timeLimit (ms) and nodeLimit (per search) are
+        // unlimited when 0
+        void Configure(size_t maxSolutions, unsigned long timeLimit, unsigned long nodeLimit)
+        {
+            this->maxSolutions = maxSolutions;
+            this->nodeLimit = nodeLimit;
+            hasDeadline = timeLimit > 0;
+            deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeLimit);
+        }
+
+        bool Stopped() const
+        {
+            return stopped || (hasDeadline && std::chrono::steady_clock::now() >= deadline);
+        }
+
+        void Stop()
+        {
+            stopped = true;
+        }
+
+        // Records a solution, returns false when enough were already found
+        // and it must be discarded
+        bool AddSolution()
+        {
+            size_t count = ++solutions;
+            if(maxSolutions && count >= maxSolutions)
+                Stop();
+            return !maxSolutions || count <= maxSolutions;
+        }
+
+        size_t Solutions() const
+        {
+            return solutions;
+        }
+
+        unsigned long NodeLimit() const
+        {
+            return nodeLimit;
+        }
+
+    private:
+        std::atomic<bool> stopped;
+        std::atomic<size_t> solutions;
+        size_t maxSolutions;
+        bool hasDeadline;
+        std::chrono::steady_clock::time_point deadline;
+        unsigned long nodeLimit;
+};
+
+// Gecode stop object of one search engine, see Search::Options::stop
+class SearchStop: public Gecode::Search::Stop
+{
+    public:
+        explicit SearchStop(const StopToken &token):
+            token(token)
+        {
+        }
+
+        virtual bool stop(const Gecode::Search::Statistics &s, const Gecode::Search::Options &)
+        {
+            return token.Stopped() || (token.NodeLimit() && s.node >= token.NodeLimit());
+        }
+
+    private:
+        const StopToken &token;
+};
+
+#endif
+
@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+# Golden-grid harness: each sample lists the words of a known valid grid.
+# They are fed back to the generator as mandatory words against a fixed
+# dictionary, a grid must come out within the latency budget, and that
+# grid is checked here, independently of the generator: its rows are split
+# into words again, which must match the word list it printed, be distinct,
+# be dictionary words and include every mandatory word.
+#
+# Exits with 1 if any sample fails, so that it can gate every change.
+
+import argparse
+import glob
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(HERE, "..", "bench"))
+import bench  # noqa: E402
+
+BLACK = "{"
+
+
+def grid_words(grid):
+    """Runs of at least 2 letters, rows first then columns"""
+    words = []
+    for lines in (grid, ["".join(column) for column in zip(*grid)]):
+        for line in lines:
+            words.extend(w for w in line.split(BLACK) if len(w) >= 2)
+    return words
+
+
+def check(grid, words, width, height, dictionary, mandatory):
+    """What is wrong with the grid, empty if nothing"""
+    if len(grid) != height or any(len(line) != width for line in grid):
+        return ["grid is not %dx%d" % (width, height)]
+    errors = []
+    if any(c != BLACK and not "a" <= c <= "z" for line in grid for c in line):
+        errors.append("unfilled or invalid cells")
+    found = grid_words(grid)
+    if sorted(found) != sorted(words):
+        errors.append("word list does not match the grid")
+    repeated = sorted(set(w for w in found if found.count(w) > 1))
+    if repeated:
+        errors.append("repeated words: " + " ".join(repeated))
+    unknown = [w for w in found if w not in dictionary]
+    if unknown:
+        errors.append("not in the dictionary: " + " ".join(unknown))
+    missing = [w for w in mandatory if w not in found]
+    if missing:
+        errors.append("mandatory words missing: " + " ".join(missing))
+    return errors
+
+
+def run(binary, dictionary, mandatory, width, height, seed, budget, timeout, cache):
+    """Runs the generator once, returns (grid, words, wall ms, search ms, error)"""
+    with tempfile.TemporaryDirectory(prefix="crosswords-golden-") as work:
+        os.symlink(os.path.abspath(dictionary), os.path.join(work, "dict"))
+        with open(os.path.join(work, "mandatory"), "w") as f:
+            f.write("\n".join(mandatory) + "\n")
+
+        # A batch of one: the grid comes as a JSON line, with its words
+        command = [os.path.abspath(binary), "--batch", "1", "--seed", str(seed), "--time-limit", str(budget),
+                   "--width", str(width), "--height", str(height), "--stats", "stats.json"]
+        command += ["--dfa-cache", cache] if cache else ["--no-dfa-cache"]
+        start = time.monotonic()
+        try:
+            result = subprocess.run(command, cwd=work, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                                    text=True, timeout=timeout)
+        except subprocess.TimeoutExpired:
+            return None, None, (time.monotonic() - start) * 1000, None, "killed after %d s" % timeout
+        wall = (time.monotonic() - start) * 1000
+
+        if result.returncode != 0:
+            return None, None, wall, None, "exit status %d: %s" % (result.returncode, result.stderr.strip())
+        try:
+            with open(os.path.join(work, "stats.json")) as f:
+                searches = json.load(f)["searches"]
+            search = min(s["ms"] for s in searches if s["solutions"] > 0)
+        except (OSError, ValueError, KeyError):
+            search = None
+
+        lines = [line for line in result.stdout.splitlines() if line.startswith("{")]
+        if not lines:
+            return None, None, wall, search, "no grid within %d ms" % budget
+        try:
+            reply = json.loads(lines[0])
+            return reply["grid"], reply["words"], wall, search, None
+        except (ValueError, KeyError):
+            return None, None, wall, search, "unreadable output: " + lines[0]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Checks the grids generated from the test-suite samples")
+    parser.add_argument("samples", nargs="*", help="word lists of known grids (default: test-suite/sample*)")
+    parser.add_argument("--binary", default="./crosswords")
+    parser.add_argument("--dict", help="dictionary (default: the synthetic one of 50000 words of bench/bench.py)")
+    parser.add_argument("--width", type=int, default=9)
+    parser.add_argument("--height", type=int, default=11)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--budget", type=int, default=60000, help="time to find each grid, in ms")
+    parser.add_argument("--timeout", type=int, default=600, help="kill a run after that many seconds")
+    parser.add_argument("--dfa-cache", help="automata cache shared by the runs (default: none, builds are cold)")
+    args = parser.parse_args()
+
+    if not os.path.exists(args.binary):
+        sys.exit("%s not found, build it first" % args.binary)
+
+    samples = args.samples or sorted(glob.glob(os.path.join(HERE, "sample*")))
+    dictionary = args.dict or bench.dictionary_file(50000, 1, os.path.join(HERE, "..", "bench", "data"))
+    with open(dictionary) as f:
+        words = set(line.strip() for line in f)
+
+    failures = 0
+    for sample in samples:
+        with open(sample) as f:
+            mandatory = [w.strip() for w in f if w.strip()]
+
+        grid, emitted, wall, search, error = run(args.binary, dictionary, mandatory, args.width, args.height,
+                                                 args.seed, args.budget, args.timeout, args.dfa_cache)
+        # Mandatory words missing from the dictionary are added to it
+        errors = [error] if error else check(grid, emitted, args.width, args.height, words | set(mandatory), mandatory)
+
+        timing = "%.0f ms" % wall + (", search %.0f ms" % search if search is not None else "")
+        if errors:
+            failures += 1
+            print("%s: FAIL (%s)" % (os.path.basename(sample), timing))
+            for e in errors:
+                print("    " + e)
+            for line in grid or []:
+                print("    " + line)
+        else:
+            print("%s: ok (%s)" % (os.path.basename(sample), timing))
+
+    print("%d/%d samples passed" % (len(samples) - failures, len(samples)))
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+# Size limits: lines longer than the word channels handle must be refused
+# with an error before any search, both as free grids and as patterns, and
+# the longest allowed line must get through the size checks.
+#
+# Exits with 1 if any case fails, like golden.py.
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+# WordChannel::MAX_CELLS
+MAX_CELLS = 63
+
+
+def run(binary, work, options, timeout):
+    """Runs the generator in work, returns (exit status, standard error)"""
+    try:
+        result = subprocess.run([os.path.abspath(binary), "--no-dfa-cache", "--time-limit", "1000"] + options,
+                                cwd=work, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True,
+                                timeout=timeout)
+    except subprocess.TimeoutExpired:
+        return None, "killed after %d s" % timeout
+    return result.returncode, result.stderr
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Checks that oversized grids are refused")
+    parser.add_argument("--binary", default="./crosswords")
+    parser.add_argument("--timeout", type=int, default=120, help="kill a run after that many seconds")
+    args = parser.parse_args()
+
+    if not os.path.exists(args.binary):
+        sys.exit("%s not found, build it first" % args.binary)
+
+    failures = 0
+    with tempfile.TemporaryDirectory(prefix="crosswords-limits-") as work:
+        # A word of every length up to one past the limit, so that the
+        # dictionary does not cut the lines short
+        with open(os.path.join(work, "dict"), "w") as f:
+            f.write("\n".join("a" * length for length in range(2, MAX_CELLS + 2)) + "\n")
+        for width in (MAX_CELLS, MAX_CELLS + 1):
+            # One row of letters over one row of black tiles: a single slot
+            # as long as the pattern is wide
+            with open(os.path.join(work, "pattern%d" % width), "w") as f:
+                f.write("." * width + "\n" + "#" * width + "\n")
+
+        cases = [
+            ("free grid %d wide" % (MAX_CELLS + 1), ["--encoding", "channel", "--width", str(MAX_CELLS + 1)],
+             "Grid dimensions must be between"),
+            ("pattern %d wide" % (MAX_CELLS + 1), ["--encoding", "channel", "--pattern", "pattern%d" % (MAX_CELLS + 1)],
+             "--encoding channel handles patterns of up to %d cells" % MAX_CELLS),
+            ("pattern %d wide" % MAX_CELLS, ["--encoding", "channel", "--pattern", "pattern%d" % MAX_CELLS], None),
+        ]
+        for name, options, error in cases:
+            status, stderr = run(args.binary, work, options, args.timeout)
+            if error is None:
+                ok = status == 0 and "cells a side" not in stderr
+                expected = "a grid"
+            else:
+                ok = status == 1 and error in stderr
+                expected = "exit status 1 with \"%s\"" % error
+            if ok:
+                print("%s: ok" % name)
+            else:
+                failures += 1
+                print("%s: FAIL (expected %s, got exit status %s)" % (name, expected, status))
+                for line in stderr.strip().splitlines():
+                    print("    " + line)
+
+    print("%d/%d cases passed" % (len(cases) - failures, len(cases)))
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
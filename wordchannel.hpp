@@ -0,0 +1,564 @@
+#ifndef WORDCHANNEL_HPP
+#define WORDCHANNEL_HPP
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+#include <gecode/int.hh>
+
+#include "dictionary.hpp"
+#include "dfa.hpp"
+#include "fill.hpp"
+
+// Links a word index variable to the letters of a line, for automata built
+// with INDEX_CHANNEL (which never see the index).
+//
+// The word starts at letters[pos - offset] and must be followed by a black
+// tile unless it touches the end of the line; len is its length. Positions
+// at or above noneFrom mean that there is no word, in which case ind is
+// MIN_INDEX and len is 0.
+//
+// The words still possible are kept per length as a sparse bitset over the
+// WordBitsets supports, non-zero blocks first and in order, so that only
+// those are scanned and copied with the space. A word stays while its index
+// is in ind and it fits at one of the remaining positions given the letter
+// domains. Each propagation only rechecks the lengths whose cells, positions
+// or indices changed since the last one, then keeps the positions, lengths
+// and indices that some remaining word supports; once pos is known, every
+// cell covered by all remaining words keeps the letters they allow.
+class WordChannel: public Gecode::Propagator
+{
+    public:
+        // Longest line: its starts and word lengths, 0 to MAX_CELLS, are
+        // bits of a uint64_t
+        static const int MAX_CELLS = 63;
+
+        WordChannel(Gecode::Home home, Gecode::ViewArray<Gecode::Int::IntView> &x, Gecode::Int::IntView pos, Gecode::Int::IntView ind, Gecode::Int::IntView len, int offset, int noneFrom, const WordBitsets &bits, const Dictionary &dict):
+            Gecode::Propagator(home),
+            x(x),
+            pos(pos),
+            ind(ind),
+            len(len),
+            offset(offset),
+            noneFrom(noneFrom),
+            bits(&bits),
+            dictionary(&dict),
+            maxLength(std::min<int>(x.size(), dict.MaxLength()))
+        {
+            Gecode::Space &space = home;
+            start = space.alloc<int>(maxLength + 1);
+            limit = space.alloc<int>(maxLength + 1);
+            positions = space.alloc<uint64_t>(maxLength + 1);
+
+            capacity = 0;
+            for(int length = 0; length <= maxLength; ++length)
+            {
+                start[length] = capacity;
+                limit[length] = 0;
+                positions[length] = 0;
+                if(length < 2)
+                    continue;
+                const uint64_t *valid = bits.Valid(length);
+                for(size_t b = 0; b < bits.Blocks(length); ++b)
+                    limit[length] += valid[b] != 0;
+                capacity += limit[length];
+            }
+
+            words = space.alloc<uint64_t>(capacity);
+            index = space.alloc<int>(capacity);
+            for(int length = 2; length <= maxLength; ++length)
+            {
+                const uint64_t *valid = bits.Valid(length);
+                int i = start[length];
+                for(size_t b = 0; b < bits.Blocks(length); ++b)
+                {
+                    if(valid[b])
+                    {
+                        words[i] = valid[b];
+                        index[i] = b;
+                        ++i;
+                    }
+                }
+            }
+
+            // 0 never matches a domain size, everything is checked once
+            lastSize = space.alloc<unsigned int>(x.size() + 3);
+            std::fill(lastSize, lastSize + x.size() + 3, 0);
+
+            x.subscribe(home, *this, Gecode::Int::PC_INT_DOM);
+            pos.subscribe(home, *this, Gecode::Int::PC_INT_DOM);
+            ind.subscribe(home, *this, Gecode::Int::PC_INT_DOM);
+            len.subscribe(home, *this, Gecode::Int::PC_INT_DOM);
+        }
+
+        WordChannel(Gecode::Space &home, WordChannel &p):
+            Gecode::Propagator(home, p),
+            offset(p.offset),
+            noneFrom(p.noneFrom),
+            bits(p.bits),
+            dictionary(p.dictionary),
+            maxLength(p.maxLength)
+        {
+            x.update(home, p.x);
+            pos.update(home, p.pos);
+            ind.update(home, p.ind);
+            len.update(home, p.len);
+
+            // Only the blocks that still have words
+            start = home.alloc<int>(maxLength + 1);
+            limit = home.alloc<int>(maxLength + 1);
+            positions = home.alloc<uint64_t>(maxLength + 1);
+            capacity = 0;
+            for(int length = 0; length <= maxLength; ++length)
+                capacity += p.limit[length];
+            words = home.alloc<uint64_t>(capacity);
+            index = home.alloc<int>(capacity);
+
+            int next = 0;
+            for(int length = 0; length <= maxLength; ++length)
+            {
+                start[length] = next;
+                limit[length] = p.limit[length];
+                positions[length] = p.positions[length];
+                std::copy(p.words + p.start[length], p.words + p.start[length] + limit[length], words + next);
+                std::copy(p.index + p.start[length], p.index + p.start[length] + limit[length], index + next);
+                next += limit[length];
+            }
+
+            lastSize = home.alloc<unsigned int>(x.size() + 3);
+            std::copy(p.lastSize, p.lastSize + x.size() + 3, lastSize);
+        }
+
+        static Gecode::ExecStatus post(Gecode::Home home, Gecode::ViewArray<Gecode::Int::IntView> &x, Gecode::Int::IntView pos, Gecode::Int::IntView ind, Gecode::Int::IntView len, int offset, int noneFrom, const WordBitsets &bits, const Dictionary &dict)
+        {
+            (void) new (home) WordChannel(home, x, pos, ind, len, offset, noneFrom, bits, dict);
+            return Gecode::ES_OK;
+        }
+
+        virtual Gecode::Propagator *copy(Gecode::Space &home)
+        {
+            return new (home) WordChannel(home, *this);
+        }
+
+        virtual Gecode::PropCost cost(const Gecode::Space &, const Gecode::ModEventDelta &) const
+        {
+            return Gecode::PropCost::linear(Gecode::PropCost::HI, x.size());
+        }
+
+        virtual void reschedule(Gecode::Space &home)
+        {
+            x.reschedule(home, *this, Gecode::Int::PC_INT_DOM);
+            pos.reschedule(home, *this, Gecode::Int::PC_INT_DOM);
+            ind.reschedule(home, *this, Gecode::Int::PC_INT_DOM);
+            len.reschedule(home, *this, Gecode::Int::PC_INT_DOM);
+        }
+
+        virtual Gecode::ExecStatus propagate(Gecode::Space &home, const Gecode::ModEventDelta &)
+        {
+            const int n = x.size();
+            Gecode::Region region;
+
+            // Letters ('a' + bit) each cell allows, and whether it may be black
+            uint32_t *cellLetters = region.alloc<uint32_t>(n);
+            bool *cellBlack = region.alloc<bool>(n);
+            for(int k = 0; k < n; ++k)
+            {
+                cellLetters[k] = 0;
+                cellBlack[k] = false;
+                for(Gecode::Int::ViewValues<Gecode::Int::IntView> it(x[k]); it(); ++it)
+                {
+                    if(it.val() >= 'a' && it.val() <= 'z')
+                        cellLetters[k] |= 1u << (it.val() - 'a');
+                    else if(it.val() == DFA_MAX_SYMBOL)
+                        cellBlack[k] = true;
+                }
+            }
+
+            // Remaining start cells, bit s for pos == s + offset
+            uint64_t starts = 0;
+            bool noneAllowed = false;
+            for(Gecode::Int::ViewValues<Gecode::Int::IntView> it(pos); it(); ++it)
+            {
+                if(it.val() >= noneFrom)
+                    noneAllowed = true;
+                else if(it.val() - offset >= 0 && it.val() - offset < n)
+                    starts |= (uint64_t) 1 << (it.val() - offset);
+            }
+
+            // Lengths to check again, bit per length
+            uint64_t dirty = 0;
+            if(pos.size() != lastSize[n])
+                dirty = ~(uint64_t) 0;
+            for(int k = 0; k < n; ++k)
+            {
+                if(x[k].size() == lastSize[k])
+                    continue;
+                // Words of length l starting at s cover the cells from s to
+                // s+l, the last one being their black tile
+                for(int length = 2; length <= maxLength; ++length)
+                {
+                    const int low = std::max(0, k - length);
+                    if((starts >> low) & (((uint64_t) 2 << (k - low)) - 1))
+                        dirty |= (uint64_t) 1 << length;
+                }
+            }
+            if(len.size() != lastSize[n+2])
+            {
+                for(int length = 2; length <= maxLength; ++length)
+                {
+                    if(!len.in(length))
+                        limit[length] = 0;
+                }
+            }
+            if(ind.size() != lastSize[n+1])
+                dirty |= removeIndices();
+
+            for(int length = 2; length <= maxLength; ++length)
+            {
+                if(limit[length] && ((dirty >> length) & 1))
+                    fit(length, starts, cellLetters, cellBlack, region);
+            }
+
+            // Supported positions, lengths and indices
+            const bool noneSupported = noneAllowed && ind.in((int) MIN_INDEX) && len.in(0);
+            uint64_t supportedStarts = 0;
+            unsigned int count = noneSupported;
+            int *keep = region.alloc<int>(std::max(pos.size(), (unsigned int) maxLength + 1));
+            int kept = 0;
+            if(noneSupported)
+                keep[kept++] = 0;
+            for(int length = 2; length <= maxLength; ++length)
+            {
+                if(!limit[length])
+                    continue;
+                supportedStarts |= positions[length];
+                keep[kept++] = length;
+                for(int i = start[length]; i < start[length] + limit[length]; ++i)
+                    count += __builtin_popcountll(words[i]);
+            }
+            if(!count)
+                return Gecode::ES_FAILED;
+
+            Gecode::Iter::Values::Array keepLen(keep, kept);
+            GECODE_ME_CHECK(len.inter_v(home, keepLen, false));
+
+            kept = 0;
+            for(int s = 0; s < n; ++s)
+            {
+                if((supportedStarts >> s) & 1)
+                    keep[kept++] = s + offset;
+            }
+            for(Gecode::Int::ViewValues<Gecode::Int::IntView> it(pos); noneSupported && it(); ++it)
+            {
+                if(it.val() >= noneFrom)
+                    keep[kept++] = it.val();
+            }
+            Gecode::Iter::Values::Array keepPos(keep, kept);
+            GECODE_ME_CHECK(pos.inter_v(home, keepPos, false));
+
+            if(ind.size() != count)
+            {
+                Values remaining(*this, noneSupported);
+                GECODE_ME_CHECK(ind.inter_v(home, remaining, false));
+            }
+
+            // Cells covered by every remaining word
+            if(pos.assigned() && pos.val() < noneFrom)
+                GECODE_ES_CHECK(restrictCells(home, pos.val() - offset, region));
+
+            for(int k = 0; k < n; ++k)
+                lastSize[k] = x[k].size();
+            lastSize[n] = pos.size();
+            lastSize[n+1] = ind.size();
+            lastSize[n+2] = len.size();
+
+            if(ind.assigned() && pos.assigned())
+                return home.ES_SUBSUMED(*this);
+            // Nothing removed above can remove another word
+            return Gecode::ES_FIX;
+        }
+
+        virtual size_t dispose(Gecode::Space &home)
+        {
+            x.cancel(home, *this, Gecode::Int::PC_INT_DOM);
+            pos.cancel(home, *this, Gecode::Int::PC_INT_DOM);
+            ind.cancel(home, *this, Gecode::Int::PC_INT_DOM);
+            len.cancel(home, *this, Gecode::Int::PC_INT_DOM);
+            home.free<uint64_t>(words, capacity);
+            home.free<int>(index, capacity);
+            home.free<int>(start, maxLength + 1);
+            home.free<int>(limit, maxLength + 1);
+            home.free<uint64_t>(positions, maxLength + 1);
+            home.free<unsigned int>(lastSize, x.size() + 3);
+            (void) Gecode::Propagator::dispose(home);
+            return sizeof(*this);
+        }
+
+    protected:
+        static const uint32_t ALL_LETTERS = (1u << 26) - 1;
+
+        // The remaining word indices in increasing order, after MIN_INDEX
+        // when there may be no word: blocks are kept in order
+        class Values
+        {
+            public:
+                Values(const WordChannel &p, bool none):
+                    p(p),
+                    length(0),
+                    i(-1),
+                    block(0),
+                    value(MIN_INDEX)
+                {
+                    if(!none)
+                        next();
+                }
+
+                bool operator()() const
+                {
+                    return value >= 0;
+                }
+
+                void operator++()
+                {
+                    next();
+                }
+
+                int val() const
+                {
+                    return value;
+                }
+
+            private:
+                void next()
+                {
+                    while(!block)
+                    {
+                        ++i;
+                        while(length <= p.maxLength && i >= p.limit[length])
+                        {
+                            ++length;
+                            i = 0;
+                        }
+                        if(length > p.maxLength)
+                        {
+                            value = -1;
+                            return;
+                        }
+                        block = p.words[p.start[length] + i];
+                    }
+                    const int bit = __builtin_ctzll(block);
+                    block &= block - 1;
+                    value = p.dictionary->FirstIndexOfLength(length) + p.index[p.start[length] + i]*64 + bit;
+                }
+
+                const WordChannel &p;
+                int length;
+                int i;
+                uint64_t block;
+                int value;
+        };
+
+        // Removes the words whose index left ind, walking its ranges along
+        // the blocks, which follow index order. Returns the lengths that
+        // lost words.
+        uint64_t removeIndices()
+        {
+            uint64_t changed = 0;
+            Gecode::Int::ViewRanges<Gecode::Int::IntView> r(ind);
+            for(int length = 2; length <= maxLength; ++length)
+            {
+                const int first = dictionary->FirstIndexOfLength(length);
+                const int last = dictionary->LastIndexOfLength(length);
+                for(int i = start[length]; i < start[length] + limit[length]; ++i)
+                {
+                    // The last block stops at the last word, the ranges
+                    // beyond belong to the next length
+                    const int low = first + index[i]*64;
+                    const int high = std::min(low + 63, last);
+                    while(r() && r.max() < low)
+                        ++r;
+
+                    uint64_t mask = 0;
+                    while(r() && r.min() <= high)
+                    {
+                        const int from = std::max(r.min(), low) - low;
+                        const int to = std::min(r.max(), high) - low;
+                        mask |= (to == 63 ? ~(uint64_t) 0 : ((uint64_t) 2 << to) - 1) & ~(((uint64_t) 1 << from) - 1);
+                        // The range may go on into the next block
+                        if(r.max() > high)
+                            break;
+                        ++r;
+                    }
+                    if(words[i] & ~mask)
+                    {
+                        words[i] &= mask;
+                        changed |= (uint64_t) 1 << length;
+                    }
+                }
+                compact(length);
+            }
+            return changed;
+        }
+
+        // Keeps the words of that length that fit at one of the starts,
+        // and records at which starts some word fits
+        void fit(int length, uint64_t starts, const uint32_t *cellLetters, const bool *cellBlack, Gecode::Region &region)
+        {
+            const int n = x.size();
+            int *candidates = region.alloc<int>(n);
+            int count = 0;
+            for(int s = 0; s + length <= n; ++s)
+            {
+                if(!((starts >> s) & 1) || (s + length < n && !cellBlack[s + length]))
+                    continue;
+                bool letters = true;
+                for(int k = 0; k < length; ++k)
+                    letters = letters && cellLetters[s + k];
+                if(letters)
+                    candidates[count++] = s;
+            }
+
+            uint64_t supported = 0;
+            for(int i = start[length]; i < start[length] + limit[length]; ++i)
+            {
+                uint64_t fits = 0;
+                for(int c = 0; c < count; ++c)
+                {
+                    const int s = candidates[c];
+                    uint64_t block = words[i];
+                    for(int k = 0; k < length && block; ++k)
+                    {
+                        if(cellLetters[s + k] != ALL_LETTERS)
+                            block &= letterMask(length, k, cellLetters[s + k], index[i]);
+                    }
+                    if(block)
+                    {
+                        fits |= block;
+                        supported |= (uint64_t) 1 << s;
+                    }
+                }
+                words[i] = fits;
+            }
+            positions[length] = supported;
+            region.free<int>(candidates, n);
+            compact(length);
+        }
+
+        // The words of a block with one of the letters at position k
+        uint64_t letterMask(int length, int k, uint32_t letters, int block) const
+        {
+            uint64_t mask = 0;
+            for(; letters; letters &= letters - 1)
+                mask |= bits->Letter(length, k, 'a' + __builtin_ctz(letters))[block];
+            return mask;
+        }
+
+        // Restricts the cells covered by every remaining word starting at s
+        // to the letters (or final black tile) that some of them allow
+        Gecode::ExecStatus restrictCells(Gecode::Space &home, int s, Gecode::Region &region)
+        {
+            int *keep = region.alloc<int>(27);
+            for(int k = s; k < x.size(); ++k)
+            {
+                if(x[k].assigned())
+                    continue;
+
+                bool covered = true;
+                bool black = false;
+                uint32_t letters = 0;
+                for(int length = 2; length <= maxLength && covered; ++length)
+                {
+                    if(!limit[length])
+                        continue;
+                    if(k - s > length)
+                        covered = false;
+                    else if(k - s == length)
+                        black = true;
+                    else
+                    {
+                        for(int c = 0; c < 26; ++c)
+                        {
+                            if(letters & (1u << c))
+                                continue;
+                            const uint64_t *support = bits->Letter(length, k - s, 'a' + c);
+                            for(int i = start[length]; i < start[length] + limit[length]; ++i)
+                            {
+                                if(words[i] & support[index[i]])
+                                {
+                                    letters |= 1u << c;
+                                    break;
+                                }
+                            }
+                        }
+                    }
+                }
+                if(!covered)
+                    break;
+
+                int kept = 0;
+                for(int c = 0; c < 26; ++c)
+                {
+                    if(letters & (1u << c))
+                        keep[kept++] = 'a' + c;
+                }
+                if(black)
+                    keep[kept++] = DFA_MAX_SYMBOL;
+                Gecode::Iter::Values::Array r(keep, kept);
+                GECODE_ME_CHECK(x[k].inter_v(home, r, false));
+            }
+            return Gecode::ES_OK;
+        }
+
+        // Drops the empty blocks of that length, keeping the others in order
+        void compact(int length)
+        {
+            int kept = start[length];
+            for(int i = start[length]; i < start[length] + limit[length]; ++i)
+            {
+                if(words[i])
+                {
+                    words[kept] = words[i];
+                    index[kept] = index[i];
+                    ++kept;
+                }
+            }
+            limit[length] = kept - start[length];
+        }
+
+        Gecode::ViewArray<Gecode::Int::IntView> x;
+        Gecode::Int::IntView pos;
+        Gecode::Int::IntView ind;
+        Gecode::Int::IntView len;
+        int offset;
+        int noneFrom;
+        const WordBitsets *bits;
+        const Dictionary *dictionary;
+        int maxLength;
+
+        // Remaining words of each length: blocks start[l] to
+        // start[l]+limit[l]-1 of words, at block index[i] of the
+        // WordBitsets ones, in increasing order
+        uint64_t *words;
+        int *index;
+        int *start;
+        int *limit;
+        int capacity;
+        // Starts (bit s) at which some word of each length fits
+        uint64_t *positions;
+        // Domain sizes of x, pos, ind and len at the end of the last
+        // propagation
+        unsigned int *lastSize;
+};
+
+// Posts WordChannel, see above. Use noneFrom = INT_MAX when the word is
+// mandatory. bits must cover the lengths of the line, which has at most
+// WordChannel::MAX_CELLS letters.
+inline void wordchannel(Gecode::Home home, const Gecode::IntVarArgs &letters, Gecode::IntVar pos, int offset, Gecode::IntVar ind, Gecode::IntVar len, int noneFrom, const WordBitsets &bits, const Dictionary &dict)
+{
+    GECODE_POST;
+    Gecode::ViewArray<Gecode::Int::IntView> x(home, letters);
+    GECODE_ES_FAIL(WordChannel::post(home, x, pos, ind, len, offset, noneFrom, bits, dict));
+}
+
+#endif
@@ -0,0 +1,279 @@
+#ifndef WORDTABLE_HPP
+#define WORDTABLE_HPP
+
+#include <algorithm>
+#include <cstdint>
+
+#include <gecode/int.hh>
+
+#include "dictionary.hpp"
+#include "fill.hpp"
+
+// Ties the letters of a fixed-length slot to its word index, without an
+// automaton: a compact table over the words of that length.
+//
+// The words still possible are a sparse bitset whose non-zero blocks are
+// kept at the front and in order, so that only those are scanned and copied
+// with the space, and their indices come out sorted. Each propagation
+// removes the words losing a letter (from the positions whose domain
+// changed since) or their index, then keeps the letters and indices that
+// some remaining word supports, in a single pass over the WordBitsets
+// supports.
+class WordTable: public Gecode::Propagator
+{
+    public:
+        WordTable(Gecode::Home home, Gecode::ViewArray<Gecode::Int::IntView> &x, Gecode::Int::IntView ind, const WordBitsets &bits, int first):
+            Gecode::Propagator(home),
+            x(x),
+            ind(ind),
+            bits(&bits),
+            first(first)
+        {
+            Gecode::Space &space = home;
+            const int length = x.size();
+            const int blocks = bits.Blocks(length);
+            const uint64_t *valid = bits.Valid(length);
+
+            capacity = blocks;
+            words = space.alloc<uint64_t>(capacity);
+            index = space.alloc<int>(capacity);
+            limit = 0;
+            for(int b = 0; b < blocks; ++b)
+            {
+                if(valid[b])
+                {
+                    words[limit] = valid[b];
+                    index[limit] = b;
+                    ++limit;
+                }
+            }
+
+            // 0 never matches a domain size, everything is checked once
+            lastSize = space.alloc<unsigned int>(length + 1);
+            std::fill(lastSize, lastSize + length + 1, 0);
+
+            x.subscribe(home, *this, Gecode::Int::PC_INT_DOM);
+            ind.subscribe(home, *this, Gecode::Int::PC_INT_DOM);
+        }
+
+        WordTable(Gecode::Space &home, WordTable &p):
+            Gecode::Propagator(home, p),
+            bits(p.bits),
+            first(p.first),
+            capacity(p.limit),
+            limit(p.limit)
+        {
+            x.update(home, p.x);
+            ind.update(home, p.ind);
+
+            // Only the blocks that still have words
+            words = home.alloc<uint64_t>(capacity);
+            index = home.alloc<int>(capacity);
+            std::copy(p.words, p.words + limit, words);
+            std::copy(p.index, p.index + limit, index);
+
+            lastSize = home.alloc<unsigned int>(x.size() + 1);
+            std::copy(p.lastSize, p.lastSize + x.size() + 1, lastSize);
+        }
+
+        static Gecode::ExecStatus post(Gecode::Home home, Gecode::ViewArray<Gecode::Int::IntView> &x, Gecode::Int::IntView ind, const WordBitsets &bits, int first)
+        {
+            (void) new (home) WordTable(home, x, ind, bits, first);
+            return Gecode::ES_OK;
+        }
+
+        virtual Gecode::Propagator *copy(Gecode::Space &home)
+        {
+            return new (home) WordTable(home, *this);
+        }
+
+        virtual Gecode::PropCost cost(const Gecode::Space &, const Gecode::ModEventDelta &) const
+        {
+            return Gecode::PropCost::linear(Gecode::PropCost::HI, limit);
+        }
+
+        virtual void reschedule(Gecode::Space &home)
+        {
+            x.reschedule(home, *this, Gecode::Int::PC_INT_DOM);
+            ind.reschedule(home, *this, Gecode::Int::PC_INT_DOM);
+        }
+
+        virtual Gecode::ExecStatus propagate(Gecode::Space &home, const Gecode::ModEventDelta &)
+        {
+            const int length = x.size();
+            Gecode::Region region;
+
+            // Words with a letter no longer possible
+            for(int k = 0; k < length; ++k)
+            {
+                if(x[k].size() == lastSize[k])
+                    continue;
+
+                int letters[LETTERS];
+                int n = 0;
+                for(Gecode::Int::ViewValues<Gecode::Int::IntView> it(x[k]); it(); ++it)
+                {
+                    if(it.val() >= 'a' && it.val() <= 'z')
+                        letters[n++] = it.val();
+                }
+
+                const uint64_t *supports[LETTERS];
+                for(int c = 0; c < n; ++c)
+                    supports[c] = bits->Letter(length, k, letters[c]);
+                for(int i = 0; i < limit; ++i)
+                {
+                    uint64_t mask = 0;
+                    for(int c = 0; c < n; ++c)
+                        mask |= supports[c][index[i]];
+                    words[i] &= mask;
+                }
+            }
+
+            // Words whose index was removed by other constraints, walking
+            // the ranges of ind along the blocks
+            if(ind.size() != lastSize[length])
+            {
+                Gecode::Int::ViewRanges<Gecode::Int::IntView> r(ind);
+                for(int i = 0; i < limit; ++i)
+                {
+                    const int low = first + index[i]*64;
+                    const int high = low + 63;
+                    while(r() && r.max() < low)
+                        ++r;
+
+                    uint64_t mask = 0;
+                    while(r() && r.min() <= high)
+                    {
+                        const int from = std::max(r.min(), low) - low;
+                        const int to = std::min(r.max(), high) - low;
+                        mask |= (to == 63 ? ~(uint64_t) 0 : ((uint64_t) 2 << to) - 1) & ~(((uint64_t) 1 << from) - 1);
+                        // The range may go on into the next block
+                        if(r.max() > high)
+                            break;
+                        ++r;
+                    }
+                    words[i] &= mask;
+                }
+            }
+
+            compact();
+            if(limit == 0)
+                return Gecode::ES_FAILED;
+
+            // Letters without a remaining word
+            for(int k = 0; k < length; ++k)
+            {
+                if(x[k].assigned())
+                    continue;
+
+                int removed[LETTERS + 1];
+                int n = 0;
+                for(Gecode::Int::ViewValues<Gecode::Int::IntView> it(x[k]); it(); ++it)
+                {
+                    if(it.val() < 'a' || it.val() > 'z' || !supported(k, it.val()))
+                        removed[n++] = it.val();
+                }
+                if(n)
+                {
+                    Gecode::Iter::Values::Array r(removed, n);
+                    GECODE_ME_CHECK(x[k].minus_v(home, r, false));
+                }
+            }
+
+            // Indices without a remaining word
+            unsigned int count = 0;
+            for(int i = 0; i < limit; ++i)
+                count += __builtin_popcountll(words[i]);
+            if(ind.size() != count)
+            {
+                // Blocks are in order, so are their indices
+                int *keep = region.alloc<int>(count);
+                int kept = 0;
+                for(int i = 0; i < limit; ++i)
+                {
+                    for(uint64_t block = words[i]; block; block &= block - 1)
+                        keep[kept++] = first + index[i]*64 + __builtin_ctzll(block);
+                }
+                Gecode::Iter::Values::Array k(keep, kept);
+                GECODE_ME_CHECK(ind.inter_v(home, k, false));
+            }
+
+            for(int k = 0; k < length; ++k)
+                lastSize[k] = x[k].size();
+            lastSize[length] = ind.size();
+
+            if(ind.assigned())
+                return home.ES_SUBSUMED(*this);
+            // Nothing removed above can remove another word
+            return Gecode::ES_FIX;
+        }
+
+        virtual size_t dispose(Gecode::Space &home)
+        {
+            x.cancel(home, *this, Gecode::Int::PC_INT_DOM);
+            ind.cancel(home, *this, Gecode::Int::PC_INT_DOM);
+            home.free<uint64_t>(words, capacity);
+            home.free<int>(index, capacity);
+            home.free<unsigned int>(lastSize, x.size() + 1);
+            (void) Gecode::Propagator::dispose(home);
+            return sizeof(*this);
+        }
+
+    protected:
+        static const int LETTERS = 26;
+
+        // Drops the empty blocks, keeping the others in order
+        void compact()
+        {
+            int kept = 0;
+            for(int i = 0; i < limit; ++i)
+            {
+                if(words[i])
+                {
+                    words[kept] = words[i];
+                    index[kept] = index[i];
+                    ++kept;
+                }
+            }
+            limit = kept;
+        }
+
+        // Whether a remaining word has that letter at position k
+        bool supported(int k, int letter) const
+        {
+            const uint64_t *support = bits->Letter(x.size(), k, letter);
+            for(int i = 0; i < limit; ++i)
+            {
+                if(words[i] & support[index[i]])
+                    return true;
+            }
+            return false;
+        }
+
+        Gecode::ViewArray<Gecode::Int::IntView> x;
+        Gecode::Int::IntView ind;
+        const WordBitsets *bits;
+        // Dictionary index of the first word of the slot's length
+        int first;
+
+        // Remaining words: block i of the bitset is words[i], at block
+        // index[i] of the WordBitsets ones, for i < limit, in increasing
+        // order
+        uint64_t *words;
+        int *index;
+        int capacity;
+        int limit;
+        // Domain sizes of x and ind at the end of the last propagation
+        unsigned int *lastSize;
+};
+
+// Posts WordTable, see above. The words of the slot are those of the
+// dictionary with as many letters as there are in letters.
+inline void wordtable(Gecode::Home home, const Gecode::IntVarArgs &letters, Gecode::IntVar ind, const WordBitsets &bits, const Dictionary &dict)
+{
+    GECODE_POST;
+    Gecode::ViewArray<Gecode::Int::IntView> x(home, letters);
+    GECODE_ES_FAIL(WordTable::post(home, x, ind, bits, dict.FirstIndexOfLength(letters.size())));
+}
+
+#endif